@@ -4,9 +4,15 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include "devices/timer.h"
+#include "intrinsic.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
 #include "threads/synch.h"
+#include "threads/vaddr.h"
+#ifdef USERPROG
+#include "threads/mmu.h"
+#include "threads/thread.h"
+#endif
 
 /* The code in this file is an interface to an ATA (IDE)
    controller.  It attempts to comply to [ATA-3]. */
@@ -28,10 +34,26 @@
 #define reg_ctl(CHANNEL) ((CHANNEL)->reg_base + 0x206)  /* Control (w/o). */
 #define reg_alt_status(CHANNEL) reg_ctl (CHANNEL)       /* Alt Status (r/o). */
 
+/* Bus master IDE port addresses, relative to the channel's slice
+   of the controller's BAR4 I/O window. */
+#define reg_bm_command(CHANNEL) ((CHANNEL)->bm_base + 0)  /* Command. */
+#define reg_bm_status(CHANNEL) ((CHANNEL)->bm_base + 2)   /* Status. */
+#define reg_bm_prdt(CHANNEL) ((CHANNEL)->bm_base + 4)     /* PRD table. */
+
 /* Alternate Status Register bits. */
 #define STA_BSY 0x80            /* Busy. */
 #define STA_DRDY 0x40           /* Device Ready. */
 #define STA_DRQ 0x08            /* Data Request. */
+#define STA_ERR 0x01            /* Error. */
+
+/* Bus Master Command Register bits. */
+#define BM_CMD_START 0x01       /* Start/stop bus master transfer. */
+#define BM_CMD_READ 0x08        /* Transfer from device to memory. */
+
+/* Bus Master Status Register bits. */
+#define BM_STA_ACTIVE 0x01      /* Transfer in progress. */
+#define BM_STA_ERR 0x02         /* DMA error. */
+#define BM_STA_INTR 0x04        /* Device raised its interrupt. */
 
 /* Control Register bits. */
 #define CTL_SRST 0x04           /* Software Reset. */
@@ -47,6 +69,46 @@
 #define CMD_IDENTIFY_DEVICE 0xec        /* IDENTIFY DEVICE. */
 #define CMD_READ_SECTOR_RETRY 0x20      /* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30     /* WRITE SECTOR with retries. */
+#define CMD_READ_MULTIPLE 0xc4          /* READ MULTIPLE. */
+#define CMD_WRITE_MULTIPLE 0xc5         /* WRITE MULTIPLE. */
+#define CMD_SET_MULTIPLE_MODE 0xc6      /* SET MULTIPLE MODE. */
+#define CMD_READ_DMA 0xc8               /* READ DMA. */
+#define CMD_WRITE_DMA 0xca              /* WRITE DMA. */
+
+/* PCI configuration space access, mechanism #1. */
+#define PCI_CONFIG_ADDR 0xcf8
+#define PCI_CONFIG_DATA 0xcfc
+#define PCI_COMMAND_BUS_MASTER 0x04     /* Command register bit. */
+
+/* One entry of a bus master Physical Region Descriptor table.
+   The region must not cross a 64 kB boundary; a size of 0 means
+   64 kB.  The last entry has PRD_EOT set. */
+struct prd {
+	uint32_t addr;              /* Physical address of the region. */
+	uint16_t size;              /* Size of the region in bytes. */
+	uint16_t flags;             /* PRD_EOT or 0. */
+};
+#define PRD_EOT 0x8000
+
+/* A DISK_MULTI_MAX-sector transfer into one buffer spans at most
+   three 64 kB windows, plus one in case the buffer is not
+   sector-aligned.  Merged requests bring a buffer each, so allow
+   for several. */
+#define PRD_CNT 32
+
+/* Most requests a user buffer is split into at a time, one per
+   page it touches.  They live on the submitter's stack. */
+#define USER_PIECE_MAX 8
+
+/* How long a queued request may be passed over for requests further
+   along the elevator's sweep before it is served out of order.
+   Readers wait on their data, so reads expire sooner. */
+#define READ_DEADLINE (TIMER_FREQ / 10)
+#define WRITE_DEADLINE TIMER_FREQ
+
+/* Set by the -dma option: use bus master DMA where the controller
+   and disk support it. */
+bool disk_use_dma;
 
 /* An ATA device. */
 struct disk {
@@ -56,11 +118,32 @@ struct disk {
 
 	bool is_ata;                /* 1=This device is an ATA disk. */
 	disk_sector_t capacity;     /* Capacity in sectors (if is_ata). */
+	bool dma;                   /* Transfer using bus master DMA. */
+	size_t multiple;            /* Sectors per interrupt in PIO mode. */
 
 	long long read_cnt;         /* Number of sectors read. */
 	long long write_cnt;        /* Number of sectors written. */
 };
 
+/* The requests carried out by a single command: a run of CNT
+   sectors from SECTOR on DISK, made up of the runs of REQS, which
+   are adjacent and sorted by sector. */
+struct batch {
+	struct list reqs;           /* Requests, empty if the channel is idle. */
+	struct disk *disk;          /* Disk of every request. */
+	disk_sector_t sector;       /* First sector. */
+	size_t cnt;                 /* Total number of sectors. */
+	bool write;                 /* Writing every request? Else reading. */
+	bool dma;                   /* Transfer by bus master DMA? */
+	bool by_caller;             /* A lone request moved by its submitter? */
+	size_t prd_cnt;             /* PRD entries the buffers need for DMA. */
+
+	/* PIO progress. */
+	size_t xfer_cnt;            /* Sectors moved so far. */
+	struct disk_request *cur;   /* Request holding the next sector. */
+	size_t cur_idx;             /* Index of that sector within CUR. */
+};
+
 /* An ATA channel (aka controller).
    Each channel can control up to two disks. */
 struct channel {
@@ -68,12 +151,28 @@ struct channel {
 	uint16_t reg_base;          /* Base I/O port. */
 	uint8_t irq;                /* Interrupt in use. */
 
-	struct lock lock;           /* Must acquire to access the controller. */
+	struct list queue;          /* Requests waiting, in arrival order. */
+	size_t queue_len;           /* Number of requests in QUEUE. */
+	struct batch active;        /* Command being carried out. */
+	disk_sector_t head;         /* Sector after the last command's run. */
 	bool expecting_interrupt;   /* True if an interrupt is expected, false if
 								   any interrupt would be spurious. */
-	struct semaphore completion_wait;   /* Up'd by interrupt handler. */
+	struct semaphore completion_wait;   /* Up'd by interrupt handler when
+										   no queued request is active. */
+
+	uint16_t bm_base;           /* Bus master I/O port, 0 if none. */
+	struct prd *prdt;           /* PRD table handed to the controller. */
 
 	struct disk devices[2];     /* The devices on this channel. */
+
+	/* Scheduler statistics. */
+	long long req_cnt;          /* Requests submitted. */
+	long long cmd_cnt;          /* Commands issued for them. */
+	long long merge_cnt;        /* Requests merged into another's command. */
+	long long expired_cnt;      /* Requests served when past deadline. */
+	long long depth_sum;        /* Sum of queue lengths seen on submit. */
+	size_t depth_max;           /* Longest queue seen. */
+	uint64_t latency_sum;       /* Cycles from submit to completion. */
 };
 
 /* We support the two "legacy" ATA channels found in a standard PC. */
@@ -84,8 +183,24 @@ static void reset_channel (struct channel *);
 static bool check_device_type (struct disk *);
 static void identify_ata_device (struct disk *);
 
-static void select_sector (struct disk *, disk_sector_t);
+static void queue_request (struct disk_request *);
+static void enqueue_request (struct disk_request *);
+static void start_request (struct channel *);
+static struct disk_request *pick_request (struct channel *);
+static void build_batch (struct channel *, struct disk_request *);
+static bool continue_request (struct channel *);
+static void finish_request (struct channel *);
+#ifdef USERPROG
+static bool transfer_user (struct disk *, disk_sector_t, size_t cnt,
+		uint8_t *, bool write);
+#endif
+static void transfer_sync (struct disk *, disk_sector_t, size_t cnt,
+		void *, bool write);
+static void pio_transfer (struct disk_request *);
+
+static void select_sector (struct disk *, disk_sector_t, size_t cnt);
 static void issue_pio_command (struct channel *, uint8_t command);
+static uint8_t pio_command (const struct disk *, bool write);
 static void input_sector (struct channel *, void *);
 static void output_sector (struct channel *, const void *);
 
@@ -94,13 +209,28 @@ static bool wait_while_busy (const struct disk *);
 static void select_device (const struct disk *);
 static void select_device_wait (const struct disk *);
 
+static uint16_t find_bus_master (void);
+static bool dma_usable (const struct disk *, const void *, size_t cnt);
+static size_t prd_count (const void *, size_t size);
+static void dma_start (struct channel *);
+static void dma_finish (struct channel *);
+
 static void interrupt_handler (struct intr_frame *);
 
+/* PRD tables, one per channel.  Must be dword aligned and must not
+   cross a 64 kB boundary. */
+static struct prd prd_tables[CHANNEL_CNT][PRD_CNT]
+	__attribute__ ((aligned (sizeof (struct prd) * PRD_CNT)));
+
 /* Initialize the disk subsystem and detect disks. */
 void
 disk_init (void) {
+	uint16_t bm_base = disk_use_dma ? find_bus_master () : 0;
 	size_t chan_no;
 
+	if (disk_use_dma && bm_base == 0)
+		printf ("disk: no bus master IDE controller, using PIO\n");
+
 	for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++) {
 		struct channel *c = &channels[chan_no];
 		int dev_no;
@@ -119,9 +249,18 @@ disk_init (void) {
 			default:
 				NOT_REACHED ();
 		}
-		lock_init (&c->lock);
+		list_init (&c->queue);
+		c->queue_len = 0;
+		list_init (&c->active.reqs);
+		c->head = 0;
+		c->req_cnt = c->cmd_cnt = c->merge_cnt = c->expired_cnt = 0;
+		c->depth_sum = 0;
+		c->depth_max = 0;
+		c->latency_sum = 0;
 		c->expecting_interrupt = false;
 		sema_init (&c->completion_wait, 0);
+		c->bm_base = bm_base != 0 ? bm_base + chan_no * 8 : 0;
+		c->prdt = prd_tables[chan_no];
 
 		/* Initialize devices. */
 		for (dev_no = 0; dev_no < 2; dev_no++) {
@@ -132,6 +271,8 @@ disk_init (void) {
 
 			d->is_ata = false;
 			d->capacity = 0;
+			d->dma = false;
+			d->multiple = 1;
 
 			d->read_cnt = d->write_cnt = 0;
 		}
@@ -173,6 +314,26 @@ disk_print_stats (void) {
 	}
 }
 
+/* Prints I/O scheduler statistics for each channel: how many
+   requests were served by how many commands, how deep the queue
+   ran, and how long requests took from submission to completion. */
+void
+disk_print_sched_stats (void) {
+	struct channel *c;
+
+	for (c = channels; c < channels + CHANNEL_CNT; c++) {
+		if (c->req_cnt == 0)
+			continue;
+		printf ("%s: %lld requests in %lld commands (%lld merged, "
+				"%lld expired), queue depth avg %lld.%lld max %zu, "
+				"avg latency %llu cycles\n",
+				c->name, c->req_cnt, c->cmd_cnt, c->merge_cnt,
+				c->expired_cnt, c->depth_sum / c->req_cnt,
+				c->depth_sum * 10 / c->req_cnt % 10, c->depth_max,
+				(unsigned long long) (c->latency_sum / c->req_cnt));
+	}
+}
+
 /* Returns the disk numbered DEV_NO--either 0 or 1 for master or
    slave, respectively--within the channel numbered CHAN_NO.
 
@@ -209,21 +370,7 @@ disk_size (struct disk *d) {
    per-disk locking is unneeded. */
 void
 disk_read (struct disk *d, disk_sector_t sec_no, void *buffer) {
-	struct channel *c;
-
-	ASSERT (d != NULL);
-	ASSERT (buffer != NULL);
-
-	c = d->channel;
-	lock_acquire (&c->lock);
-	select_sector (d, sec_no);
-	issue_pio_command (c, CMD_READ_SECTOR_RETRY);
-	sema_down (&c->completion_wait);
-	if (!wait_while_busy (d))
-		PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
-	input_sector (c, buffer);
-	d->read_cnt++;
-	lock_release (&c->lock);
+	disk_read_multi (d, sec_no, 1, buffer);
 }
 
 /* Write sector SEC_NO to disk D from BUFFER, which must contain
@@ -233,26 +380,472 @@ disk_read (struct disk *d, disk_sector_t sec_no, void *buffer) {
    per-disk locking is unneeded. */
 void
 disk_write (struct disk *d, disk_sector_t sec_no, const void *buffer) {
-	struct channel *c;
+	disk_write_multi (d, sec_no, 1, buffer);
+}
+
+/* Reads CNT consecutive sectors starting at SEC_NO from disk D
+   into BUFFER, which must have room for CNT * DISK_SECTOR_SIZE
+   bytes, and waits for them to arrive.  The whole run is
+   transferred by a single command.  In DMA mode the device
+   interrupts once for the whole run, otherwise once per block of
+   as many sectors as its multiple mode allows.
+   CNT must be between 1 and DISK_MULTI_MAX.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+void
+disk_read_multi (struct disk *d, disk_sector_t sec_no, size_t cnt,
+		void *buffer) {
+	transfer_sync (d, sec_no, cnt, buffer, false);
+}
+
+/* Writes CNT consecutive sectors starting at SEC_NO to disk D
+   from BUFFER, which must contain CNT * DISK_SECTOR_SIZE bytes,
+   using a single command.  Returns after the disk has
+   acknowledged receiving the last sector.  CNT must be between 1
+   and DISK_MULTI_MAX.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+void
+disk_write_multi (struct disk *d, disk_sector_t sec_no, size_t cnt,
+		const void *buffer) {
+	transfer_sync (d, sec_no, cnt, (void *) buffer, true);
+}
+
+/* Initializes R to transfer CNT sectors starting at SEC_NO
+   between disk D and BUFFER, writing them to D if WRITE and
+   reading them otherwise.  The caller may then set R's DONE,
+   AUX and SEMA before passing it to disk_submit(). */
+void
+disk_request_init (struct disk_request *r, struct disk *d,
+		disk_sector_t sec_no, size_t cnt, void *buffer, bool write) {
+	r->disk = d;
+	r->sector = sec_no;
+	r->cnt = cnt;
+	r->buffer = buffer;
+	r->write = write;
+	r->done = NULL;
+	r->aux = NULL;
+	r->sema = NULL;
+	r->by_caller = false;
+}
+
+/* Queues request R on its disk's channel and returns at once.
+   The channel's interrupt handler drives requests to completion
+   one command at a time, then ups R's SEMA and calls its DONE
+   function.  Pending requests are served in elevator order, and
+   adjacent ones are merged into one command, so R may complete
+   before requests submitted earlier.  R's buffer must be a kernel
+   address, because the handler may run in any thread.
+   May be called with interrupts off, but not from an interrupt
+   handler other than a DONE function. */
+void
+disk_submit (struct disk_request *r) {
+	ASSERT (r->disk != NULL);
+	ASSERT (r->buffer != NULL && is_kernel_vaddr (r->buffer));
+	ASSERT (r->cnt > 0 && r->cnt <= DISK_MULTI_MAX);
+	ASSERT (r->sector + r->cnt <= r->disk->capacity);
+
+	queue_request (r);
+}
+
+/* Transfers CNT sectors starting at SEC_NO between disk D and
+   BUFFER through the channel's queue, and waits for the transfer
+   to finish.  A user BUFFER goes through the queue at its kernel
+   addresses if it can, see transfer_user(). */
+static void
+transfer_sync (struct disk *d, disk_sector_t sec_no, size_t cnt,
+		void *buffer, bool write) {
+	struct disk_request r;
+	struct semaphore done;
+	enum intr_level old_level;
 
 	ASSERT (d != NULL);
 	ASSERT (buffer != NULL);
+	ASSERT (cnt > 0 && cnt <= DISK_MULTI_MAX);
+	ASSERT (sec_no + cnt <= d->capacity);
+	ASSERT (!intr_context ());
+
+	sema_init (&done, 0);
+	disk_request_init (&r, d, sec_no, cnt, buffer, write);
+	r.sema = &done;
+	if (is_kernel_vaddr (buffer)) {
+		queue_request (&r);
+		sema_down (&done);
+		return;
+	}
+#ifdef USERPROG
+	if (transfer_user (d, sec_no, cnt, buffer, write))
+		return;
+#endif
+
+	/* Otherwise the user buffer is only mapped while this thread
+	   runs, where the interrupt handler cannot reach it.  Wait for
+	   our turn on the channel, then move the data ourselves by
+	   PIO. */
+	r.by_caller = true;
+	queue_request (&r);
+	sema_down (&done);
+	pio_transfer (&r);
+
+	old_level = intr_disable ();
+	r.sema = NULL;
+	finish_request (d->channel);
+	intr_set_level (old_level);
+}
+
+#ifdef USERPROG
+/* Transfers CNT sectors starting at SEC_NO between disk D and the
+   user BUFFER like a kernel buffer, by queuing a request for the
+   part of BUFFER in each page at the page's kernel address, which
+   the current thread's page table gives.  The caller must keep
+   the pages mapped, e.g. by pinning their frames.  The requests
+   are queued together, so that they merge into one command that
+   uses DMA if the disk does.  Returns false, having transferred
+   nothing, if BUFFER is not sector-aligned or not all mapped. */
+static bool
+transfer_user (struct disk *d, disk_sector_t sec_no, size_t cnt,
+		uint8_t *buffer, bool write) {
+	struct disk_request pieces[USER_PIECE_MAX];
+	struct semaphore done;
+	uint64_t *pml4 = thread_current ()->pml4;
+	uint8_t *upage;
+
+	/* Then no sector straddles two pages. */
+	if ((uintptr_t) buffer % DISK_SECTOR_SIZE != 0)
+		return false;
+	for (upage = pg_round_down (buffer);
+			upage < buffer + cnt * DISK_SECTOR_SIZE; upage += PGSIZE)
+		if (pml4 == NULL || pml4_get_page (pml4, upage) == NULL)
+			return false;
+
+	sema_init (&done, 0);
+	while (cnt > 0) {
+		enum intr_level old_level;
+		size_t piece_cnt = 0;
+
+		old_level = intr_disable ();
+		while (cnt > 0 && piece_cnt < USER_PIECE_MAX) {
+			struct disk_request *r = &pieces[piece_cnt++];
+			size_t n = (PGSIZE - pg_ofs (buffer)) / DISK_SECTOR_SIZE;
+
+			if (n > cnt)
+				n = cnt;
+			disk_request_init (r, d, sec_no, n,
+					pml4_get_page (pml4, buffer), write);
+			r->sema = &done;
+			enqueue_request (r);
+			sec_no += n;
+			buffer += n * DISK_SECTOR_SIZE;
+			cnt -= n;
+		}
+		start_request (d->channel);
+		intr_set_level (old_level);
+
+		while (piece_cnt-- > 0)
+			sema_down (&done);
+	}
+	return true;
+}
+#endif
+
+/* Appends R to its channel's queue, starting it if the channel
+   is idle. */
+static void
+queue_request (struct disk_request *r) {
+	enum intr_level old_level = intr_disable ();
+
+	enqueue_request (r);
+	start_request (r->disk->channel);
+	intr_set_level (old_level);
+}
+
+/* Appends R to its channel's queue without starting it.  Must be
+   called with interrupts off. */
+static void
+enqueue_request (struct disk_request *r) {
+	struct channel *c = r->disk->channel;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	r->deadline = timer_ticks () + (r->write ? WRITE_DEADLINE : READ_DEADLINE);
+	r->start = rdtsc ();
+	list_push_back (&c->queue, &r->elem);
+	c->queue_len++;
+	c->req_cnt++;
+	c->depth_sum += c->queue_len;
+	if (c->queue_len > c->depth_max)
+		c->depth_max = c->queue_len;
+}
+
+/* Chooses the queued request to serve next on channel C by C-LOOK:
+   the one with the lowest sector at or past the end of the last
+   command, or, once the sweep has passed every request, the lowest
+   sector overall.  The oldest request goes first instead if it has
+   waited past its deadline. */
+static struct disk_request *
+pick_request (struct channel *c) {
+	struct disk_request *oldest, *next = NULL, *lowest = NULL;
+	struct list_elem *e;
+
+	oldest = list_entry (list_front (&c->queue), struct disk_request, elem);
+	if (timer_ticks () >= oldest->deadline) {
+		c->expired_cnt++;
+		return oldest;
+	}
+
+	for (e = list_begin (&c->queue); e != list_end (&c->queue);
+			e = list_next (e)) {
+		struct disk_request *r = list_entry (e, struct disk_request, elem);
+
+		if (r->sector >= c->head && (next == NULL || r->sector < next->sector))
+			next = r;
+		if (lowest == NULL || r->sector < lowest->sector)
+			lowest = r;
+	}
+	return next != NULL ? next : lowest;
+}
+
+/* Returns true if queued request M can join channel C's active
+   batch B in one command. */
+static bool
+batch_can_merge (const struct batch *b, const struct disk_request *m) {
+	if (m->disk != b->disk || m->write != b->write || m->by_caller
+			|| b->cnt + m->cnt > DISK_MULTI_MAX)
+		return false;
+	if (m->sector != b->sector + b->cnt && m->sector + m->cnt != b->sector)
+		return false;
+	/* Don't give up DMA for the sake of a merge. */
+	return !b->dma || (dma_usable (m->disk, m->buffer, m->cnt)
+			&& b->prd_cnt + prd_count (m->buffer, m->cnt * DISK_SECTOR_SIZE)
+			<= PRD_CNT);
+}
+
+/* Makes R channel C's active batch, moving it off the queue, and
+   merges into it every queued request that extends its run at
+   either end. */
+static void
+build_batch (struct channel *c, struct disk_request *r) {
+	struct batch *b = &c->active;
+	bool merged;
+
+	list_remove (&r->elem);
+	c->queue_len--;
+	list_push_back (&b->reqs, &r->elem);
+	b->disk = r->disk;
+	b->sector = r->sector;
+	b->cnt = r->cnt;
+	b->write = r->write;
+	b->by_caller = r->by_caller;
+	b->dma = !r->by_caller && dma_usable (r->disk, r->buffer, r->cnt);
+	b->prd_cnt = b->dma ? prd_count (r->buffer, r->cnt * DISK_SECTOR_SIZE) : 0;
+	if (b->by_caller)
+		return;
+
+	do {
+		struct list_elem *e;
+
+		merged = false;
+		for (e = list_begin (&c->queue); e != list_end (&c->queue);
+				e = list_next (e)) {
+			struct disk_request *m = list_entry (e, struct disk_request, elem);
+
+			if (!batch_can_merge (b, m))
+				continue;
+			list_remove (&m->elem);
+			c->queue_len--;
+			if (m->sector < b->sector) {
+				list_push_front (&b->reqs, &m->elem);
+				b->sector = m->sector;
+			} else
+				list_push_back (&b->reqs, &m->elem);
+			b->cnt += m->cnt;
+			if (b->dma)
+				b->prd_cnt += prd_count (m->buffer, m->cnt * DISK_SECTOR_SIZE);
+			c->merge_cnt++;
+			merged = true;
+			break;
+		}
+	} while (merged);
+}
+
+/* Returns where the next sector of channel C's active PIO batch
+   goes to or comes from. */
+static uint8_t *
+batch_buffer (struct channel *c) {
+	struct batch *b = &c->active;
+	return (uint8_t *) b->cur->buffer + b->cur_idx * DISK_SECTOR_SIZE;
+}
 
-	c = d->channel;
-	lock_acquire (&c->lock);
-	select_sector (d, sec_no);
-	issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
+/* Steps channel C's active PIO batch past the sector just moved. */
+static void
+batch_advance (struct channel *c) {
+	struct batch *b = &c->active;
+
+	if (++b->cur_idx == b->cur->cnt && b->xfer_cnt + 1 < b->cnt) {
+		b->cur = list_entry (list_next (&b->cur->elem),
+				struct disk_request, elem);
+		b->cur_idx = 0;
+	}
+	b->xfer_cnt++;
+}
+
+/* Moves the next block of channel C's active PIO batch through the
+   data register: as many sectors as the disk transfers per
+   interrupt, or fewer at the end of the run.  The caller must have
+   seen DRQ set. */
+static void
+batch_pio_block (struct channel *c) {
+	struct batch *b = &c->active;
+	size_t i, cnt = b->cnt - b->xfer_cnt;
+
+	if (cnt > b->disk->multiple)
+		cnt = b->disk->multiple;
+	for (i = 0; i < cnt; i++) {
+		if (b->write)
+			output_sector (c, batch_buffer (c));
+		else
+			input_sector (c, batch_buffer (c));
+		batch_advance (c);
+	}
+}
+
+/* If channel C is idle, picks the next queued request, merges its
+   neighbors into it, and issues the command for the batch.  A
+   request whose data the submitter moves itself is handed back to
+   the submitter instead.  Must be called with interrupts off. */
+static void
+start_request (struct channel *c) {
+	struct batch *b = &c->active;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	if (!list_empty (&b->reqs) || list_empty (&c->queue))
+		return;
+	build_batch (c, pick_request (c));
+	b->xfer_cnt = 0;
+	b->cur = list_entry (list_front (&b->reqs), struct disk_request, elem);
+	b->cur_idx = 0;
+	c->head = b->sector + b->cnt;
+	c->cmd_cnt++;
+
+	if (b->by_caller)
+		sema_up (b->cur->sema);
+	else if (b->dma)
+		dma_start (c);
+	else {
+		select_sector (b->disk, b->sector, b->cnt);
+		issue_pio_command (c, pio_command (b->disk, b->write));
+		/* A write hands the device its first block now and each
+		   later one when the previous one's interrupt comes in. */
+		if (b->write) {
+			if (!wait_while_busy (b->disk))
+				PANIC ("%s: disk write failed, sector=%"PRDSNu,
+						b->disk->name, b->sector);
+			batch_pio_block (c);
+		}
+	}
+}
+
+/* Carries channel C's active batch on after an interrupt.
+   Returns true if the batch is now complete. */
+static bool
+continue_request (struct channel *c) {
+	struct batch *b = &c->active;
+	struct disk *d = b->disk;
+
+	if (b->dma) {
+		dma_finish (c);
+		return true;
+	}
+
+	if (!b->write) {
+		if (!wait_while_busy (d))
+			PANIC ("%s: disk read failed, sector=%"PRDSNu,
+					d->name, b->sector + (disk_sector_t) b->xfer_cnt);
+		batch_pio_block (c);
+		return b->xfer_cnt == b->cnt;
+	}
+
+	/* The device took the block we last gave it. */
+	if (b->xfer_cnt == b->cnt)
+		return true;
 	if (!wait_while_busy (d))
-		PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
-	output_sector (c, buffer);
-	sema_down (&c->completion_wait);
-	d->write_cnt++;
-	lock_release (&c->lock);
+		PANIC ("%s: disk write failed, sector=%"PRDSNu,
+				d->name, b->sector + (disk_sector_t) b->xfer_cnt);
+	batch_pio_block (c);
+	return false;
 }
-
+
+/* Retires channel C's active batch, starts the next one so that
+   the disk stays busy, and then notifies the submitter of each
+   retired request.  Must be called with interrupts off. */
+static void
+finish_request (struct channel *c) {
+	struct batch *b = &c->active;
+	struct list done;
+	uint64_t now = rdtsc ();
+
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	if (b->write)
+		b->disk->write_cnt += b->cnt;
+	else
+		b->disk->read_cnt += b->cnt;
+	list_init (&done);
+	while (!list_empty (&b->reqs))
+		list_push_back (&done, list_pop_front (&b->reqs));
+	c->expecting_interrupt = false;
+	start_request (c);
+
+	/* A DONE function may resubmit its request, so take each one
+	   off DONE before notifying. */
+	while (!list_empty (&done)) {
+		struct disk_request *r = list_entry (list_pop_front (&done),
+				struct disk_request, elem);
+		c->latency_sum += now - r->start;
+		if (r->sema != NULL)
+			sema_up (r->sema);
+		if (r->done != NULL)
+			r->done (r);
+	}
+}
+
+/* Moves the data of request R, which is active on its channel,
+   by programmed I/O in the submitting thread, sleeping on the
+   channel's completion_wait for each block's interrupt. */
+static void
+pio_transfer (struct disk_request *r) {
+	struct disk *d = r->disk;
+	struct channel *c = d->channel;
+	uint8_t *p = r->buffer;
+	size_t i, j, cnt;
+
+	select_sector (d, r->sector, r->cnt);
+	issue_pio_command (c, pio_command (d, r->write));
+	for (i = 0; i < r->cnt; i += cnt) {
+		cnt = r->cnt - i < d->multiple ? r->cnt - i : d->multiple;
+		if (r->write) {
+			if (!wait_while_busy (d))
+				PANIC ("%s: disk write failed, sector=%"PRDSNu,
+						d->name, r->sector + (disk_sector_t) i);
+			for (j = i; j < i + cnt; j++)
+				output_sector (c, p + j * DISK_SECTOR_SIZE);
+			sema_down (&c->completion_wait);
+		} else {
+			sema_down (&c->completion_wait);
+			if (!wait_while_busy (d))
+				PANIC ("%s: disk read failed, sector=%"PRDSNu,
+						d->name, r->sector + (disk_sector_t) i);
+			for (j = i; j < i + cnt; j++)
+				input_sector (c, p + j * DISK_SECTOR_SIZE);
+		}
+	}
+}
+
 /* Disk detection and identification. */
 
 static void print_ata_string (char *string, size_t size);
+static void set_multiple_mode (struct disk *, size_t max);
 
 /* Resets an ATA channel and waits for any devices present on it
    to finish the reset. */
@@ -364,6 +957,14 @@ identify_ata_device (struct disk *d) {
 	/* Calculate capacity. */
 	d->capacity = id[60] | ((uint32_t) id[61] << 16);
 
+	/* Word 49 bit 8: DMA supported. */
+	d->dma = c->bm_base != 0 && (id[49] & (1 << 8)) != 0;
+
+	/* Word 47 bits 7:0: most sectors READ/WRITE MULTIPLE can move
+	   per interrupt. */
+	if ((id[47] & 0xff) > 1)
+		set_multiple_mode (d, id[47] & 0xff);
+
 	/* Print identification message. */
 	printf ("%s: detected %'"PRDSNu" sector (", d->name, d->capacity);
 	if (d->capacity > 1024 / DISK_SECTOR_SIZE * 1024 * 1024)
@@ -379,7 +980,27 @@ identify_ata_device (struct disk *d) {
 	print_ata_string ((char *) &id[27], 40);
 	printf ("\", serial \"");
 	print_ata_string ((char *) &id[10], 20);
-	printf ("\"\n");
+	printf ("\"%s\n", d->dma ? ", DMA" : "");
+}
+
+/* Asks disk D to move the largest power of two sectors up to MAX
+   per interrupt under READ MULTIPLE and WRITE MULTIPLE, and if it
+   agrees, has PIO transfers use those commands. */
+static void
+set_multiple_mode (struct disk *d, size_t max) {
+	struct channel *c = d->channel;
+	size_t cnt = 1;
+
+	while (cnt * 2 <= max)
+		cnt *= 2;
+
+	select_device_wait (d);
+	outb (reg_nsect (c), cnt);
+	issue_pio_command (c, CMD_SET_MULTIPLE_MODE);
+	sema_down (&c->completion_wait);
+	wait_while_busy (d);
+	if (!(inb (reg_alt_status (c)) & STA_ERR))
+		d->multiple = cnt;
 }
 
 /* Prints STRING, which consists of SIZE bytes in a funky format:
@@ -402,17 +1023,19 @@ print_ata_string (char *string, size_t size) {
 }
 
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
+   writes SEC_NO and the sector count CNT to the disk's sector
+   selection registers.  (We use LBA mode.)  A count register of 0
+   means 256 sectors. */
 static void
-select_sector (struct disk *d, disk_sector_t sec_no) {
+select_sector (struct disk *d, disk_sector_t sec_no, size_t cnt) {
 	struct channel *c = d->channel;
 
 	ASSERT (sec_no < d->capacity);
 	ASSERT (sec_no < (1UL << 28));
+	ASSERT (cnt > 0 && cnt <= DISK_MULTI_MAX);
 
 	select_device_wait (d);
-	outb (reg_nsect (c), 1);
+	outb (reg_nsect (c), cnt == DISK_MULTI_MAX ? 0 : cnt);
 	outb (reg_lbal (c), sec_no);
 	outb (reg_lbam (c), sec_no >> 8);
 	outb (reg_lbah (c), (sec_no >> 16));
@@ -424,14 +1047,20 @@ select_sector (struct disk *d, disk_sector_t sec_no) {
    completion interrupt. */
 static void
 issue_pio_command (struct channel *c, uint8_t command) {
-	/* Interrupts must be enabled or our semaphore will never be
-	   up'd by the completion handler. */
-	ASSERT (intr_get_level () == INTR_ON);
-
 	c->expecting_interrupt = true;
 	outb (reg_command (c), command);
 }
 
+/* Returns the PIO command that reads, or if WRITE writes, a run of
+   sectors on disk D: READ/WRITE MULTIPLE if D has a multiple mode
+   set, else one interrupt per sector. */
+static uint8_t
+pio_command (const struct disk *d, bool write) {
+	if (d->multiple > 1)
+		return write ? CMD_WRITE_MULTIPLE : CMD_READ_MULTIPLE;
+	return write ? CMD_WRITE_SECTOR_RETRY : CMD_READ_SECTOR_RETRY;
+}
+
 /* Reads a sector from channel C's data register in PIO mode into
    SECTOR, which must have room for DISK_SECTOR_SIZE bytes. */
 static void
@@ -446,6 +1075,144 @@ output_sector (struct channel *c, const void *sector) {
 	outsw (reg_data (c), sector, DISK_SECTOR_SIZE / 2);
 }
 
+/* Bus master DMA. */
+
+/* Reads the 32-bit PCI configuration register REG of function
+   FUNC of device DEV on bus BUS. */
+static uint32_t
+pci_read_config (int bus, int dev, int func, int reg) {
+	outl (PCI_CONFIG_ADDR, 0x80000000 | (bus << 16) | (dev << 11)
+			| (func << 8) | (reg & 0xfc));
+	return inl (PCI_CONFIG_DATA);
+}
+
+/* Writes DATA to the 32-bit PCI configuration register REG of
+   function FUNC of device DEV on bus BUS. */
+static void
+pci_write_config (int bus, int dev, int func, int reg, uint32_t data) {
+	outl (PCI_CONFIG_ADDR, 0x80000000 | (bus << 16) | (dev << 11)
+			| (func << 8) | (reg & 0xfc));
+	outl (PCI_CONFIG_DATA, data);
+}
+
+/* Looks on PCI bus 0 for an IDE controller that can act as bus
+   master, enables bus mastering on it, and returns the I/O port
+   of its bus master registers (BAR4).  Returns 0 if there is
+   none. */
+static uint16_t
+find_bus_master (void) {
+	int dev, func;
+
+	for (dev = 0; dev < 32; dev++)
+		for (func = 0; func < 8; func++) {
+			uint32_t class = pci_read_config (0, dev, func, 0x08);
+			uint32_t bar4, command;
+
+			if ((pci_read_config (0, dev, func, 0x00) & 0xffff) == 0xffff)
+				continue;
+			/* Class 01h (mass storage), subclass 01h (IDE), with
+			   programming interface bit 7 (bus master capable). */
+			if ((class >> 16) != 0x0101 || !(class & (0x80 << 8)))
+				continue;
+
+			bar4 = pci_read_config (0, dev, func, 0x20);
+			if (!(bar4 & 1) || (bar4 & ~3u) == 0)
+				continue;
+
+			command = pci_read_config (0, dev, func, 0x04);
+			pci_write_config (0, dev, func, 0x04,
+					(command & 0xffff) | PCI_COMMAND_BUS_MASTER);
+			return bar4 & 0xfffc;
+		}
+	return 0;
+}
+
+/* Returns true if a CNT-sector transfer to or from BUFFER on disk
+   D can be done by DMA.  The controller takes 32-bit physical
+   addresses of word-aligned, physically contiguous regions; every
+   kernel virtual address maps linearly onto physical memory. */
+static bool
+dma_usable (const struct disk *d, const void *buffer, size_t cnt) {
+	uint64_t start;
+
+	if (!d->dma || !is_kernel_vaddr (buffer) || (uintptr_t) buffer & 1)
+		return false;
+	start = vtop (buffer);
+	return start + cnt * DISK_SECTOR_SIZE <= (1ULL << 32);
+}
+
+/* Returns the number of PRD entries that describe the SIZE bytes
+   at BUFFER, one per 64 kB window they touch. */
+static size_t
+prd_count (const void *buffer, size_t size) {
+	uint64_t addr = vtop (buffer);
+	return (addr + size - 1) / 0x10000 - addr / 0x10000 + 1;
+}
+
+/* Appends entries describing the SIZE bytes at BUFFER to C's PRD
+   table, starting at entry *I and advancing *I. */
+static void
+build_prdt (struct channel *c, void *buffer, size_t size, size_t *i) {
+	uint64_t addr = vtop (buffer);
+
+	for (; size > 0; (*i)++) {
+		/* Bytes up to the next 64 kB boundary. */
+		size_t chunk = 0x10000 - (addr & 0xffff);
+		if (chunk > size)
+			chunk = size;
+
+		ASSERT (*i < PRD_CNT);
+		c->prdt[*i].addr = addr;
+		c->prdt[*i].size = chunk & 0xffff;
+		c->prdt[*i].flags = 0;
+		addr += chunk;
+		size -= chunk;
+	}
+}
+
+/* Issues the single READ DMA or WRITE DMA command that carries
+   out channel C's active batch, which must have passed
+   dma_usable().  Its interrupt comes when the whole run is done. */
+static void
+dma_start (struct channel *c) {
+	struct batch *b = &c->active;
+	uint8_t direction = b->write ? 0 : BM_CMD_READ;
+	struct list_elem *e;
+	size_t i = 0;
+
+	for (e = list_begin (&b->reqs); e != list_end (&b->reqs);
+			e = list_next (e)) {
+		struct disk_request *r = list_entry (e, struct disk_request, elem);
+		build_prdt (c, r->buffer, r->cnt * DISK_SECTOR_SIZE, &i);
+	}
+	c->prdt[i - 1].flags = PRD_EOT;
+	outl (reg_bm_prdt (c), vtop (c->prdt));
+	outb (reg_bm_command (c), direction);
+	/* Clear the interrupt and error bits by writing them back. */
+	outb (reg_bm_status (c),
+			inb (reg_bm_status (c)) | BM_STA_INTR | BM_STA_ERR);
+
+	select_sector (b->disk, b->sector, b->cnt);
+	issue_pio_command (c, b->write ? CMD_WRITE_DMA : CMD_READ_DMA);
+	outb (reg_bm_command (c), direction | BM_CMD_START);
+}
+
+/* Stops the bus master after the completion interrupt of channel
+   C's active batch and checks that the transfer went through. */
+static void
+dma_finish (struct channel *c) {
+	struct batch *b = &c->active;
+	uint8_t bm_status, status;
+
+	outb (reg_bm_command (c), 0);
+	bm_status = inb (reg_bm_status (c));
+	outb (reg_bm_status (c), bm_status | BM_STA_INTR | BM_STA_ERR);
+	status = inb (reg_alt_status (c));
+	if ((bm_status & BM_STA_ERR) || (status & STA_ERR))
+		PANIC ("%s: DMA %s failed, sector=%"PRDSNu, b->disk->name,
+				b->write ? "write" : "read", b->sector);
+}
+
 /* Low-level ATA primitives. */
 
 /* Wait up to 10 seconds for the controller to become idle, that
@@ -460,7 +1227,7 @@ wait_until_idle (const struct disk *d) {
 	for (i = 0; i < 1000; i++) {
 		if ((inb (reg_status (d->channel)) & (STA_BSY | STA_DRQ)) == 0)
 			return;
-		timer_usleep (10);
+		timer_udelay (10);
 	}
 
 	printf ("%s: idle timeout\n", d->name);
@@ -469,21 +1236,30 @@ wait_until_idle (const struct disk *d) {
 /* Wait up to 30 seconds for disk D to clear BSY,
    and then return the status of the DRQ bit.
    The ATA standards say that a disk may take as long as that to
-   complete its reset. */
+   complete its reset.  With interrupts off, as when called from
+   the interrupt handler, busy-waits in 10 us steps instead of
+   sleeping, so that it notices the disk going idle at once. */
 static bool
 wait_while_busy (const struct disk *d) {
 	struct channel *c = d->channel;
-	int i;
+	int64_t waited;             /* Microseconds waited so far. */
 
-	for (i = 0; i < 3000; i++) {
-		if (i == 700)
-			printf ("%s: busy, waiting...", d->name);
+	for (waited = 0; waited < 30 * 1000 * 1000; ) {
+		bool warned = waited >= 7 * 1000 * 1000;
 		if (!(inb (reg_alt_status (c)) & STA_BSY)) {
-			if (i >= 700)
+			if (warned)
 				printf ("ok\n");
 			return (inb (reg_alt_status (c)) & STA_DRQ) != 0;
 		}
-		timer_msleep (10);
+		if (intr_get_level () == INTR_ON) {
+			timer_msleep (10);
+			waited += 10 * 1000;
+		} else {
+			timer_udelay (10);
+			waited += 10;
+		}
+		if (!warned && waited >= 7 * 1000 * 1000)
+			printf ("%s: busy, waiting...", d->name);
 	}
 
 	printf ("failed\n");
@@ -499,7 +1275,7 @@ select_device (const struct disk *d) {
 		dev |= DEV_DEV;
 	outb (reg_device (c), dev);
 	inb (reg_alt_status (c));
-	timer_nsleep (400);
+	timer_ndelay (400);
 }
 
 /* Select disk D in its channel, as select_device(), but wait for
@@ -520,7 +1296,10 @@ interrupt_handler (struct intr_frame *f) {
 		if (f->vec_no == c->irq) {
 			if (c->expecting_interrupt) {
 				inb (reg_status (c));               /* Acknowledge interrupt. */
-				sema_up (&c->completion_wait);      /* Wake up waiter. */
+				if (list_empty (&c->active.reqs) || c->active.by_caller)
+					sema_up (&c->completion_wait);  /* Wake up waiter. */
+				else if (continue_request (c))
+					finish_request (c);
 			} else
 				printf ("%s: unexpected interrupt\n", c->name);
 			return;
@@ -7,6 +7,7 @@
 #include "threads/io.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
+#include "intrinsic.h"
 
 /* See [8254] for hardware details of the 8254 timer chip. */
 
@@ -20,6 +21,12 @@
 /* Number of timer ticks since OS booted. */
 static int64_t ticks;
 
+/* TSC cycles spent in, and number of calls to, the timer
+   interrupt handler, counted only while INTR_TIMING is true. */
+static bool intr_timing;
+static uint64_t intr_cycles;
+static uint64_t intr_cnt;
+
 /* Number of loops per timer tick.
    Initialized by timer_calibrate(). */
 static unsigned loops_per_tick;
@@ -28,6 +35,7 @@ static intr_handler_func timer_interrupt;
 static bool too_many_loops (unsigned loops);
 static void busy_wait (int64_t loops);
 static void real_time_sleep (int64_t num, int32_t denom);
+static void real_time_delay (int64_t num, int32_t denom);
 
 /* Sets up the 8254 Programmable Interval Timer (PIT) to
    interrupt PIT_FREQ times per second, and registers the
@@ -117,21 +125,61 @@ timer_nsleep (int64_t ns) {
 	real_time_sleep (ns, 1000 * 1000 * 1000);
 }
 
+/* Busy-waits for approximately US microseconds.  Unlike
+   timer_usleep(), may be called with interrupts off, e.g. from an
+   interrupt handler.  Busy waiting with interrupts off for a timer
+   tick or longer loses timer ticks, so keep the delay brief. */
+void
+timer_udelay (int64_t us) {
+	real_time_delay (us, 1000 * 1000);
+}
+
+/* Busy-waits for approximately NS nanoseconds.  Like
+   timer_udelay(), may be called with interrupts off. */
+void
+timer_ndelay (int64_t ns) {
+	real_time_delay (ns, 1000 * 1000 * 1000);
+}
+
 /* Prints timer statistics. */
 void
 timer_print_stats (void) {
 	printf ("Timer: %"PRId64" ticks\n", timer_ticks ());
 }
 
+/* Starts counting the TSC cycles spent in the timer interrupt
+   handler if ON is true, stops if it is false.  Counting is off
+   by default, so that the handler does not pay for it outside
+   the benchmark that reads the counts. */
+void
+timer_intr_timing (bool on) {
+	intr_timing = on;
+}
+
+/* Stores the total TSC cycles counted in the timer interrupt
+   handler into *CYCLES and the number of interrupts handled into
+   *CNT. */
+void
+timer_intr_stats (uint64_t *cycles, uint64_t *cnt) {
+	enum intr_level old_level = intr_disable ();
+	*cycles = intr_cycles;
+	*cnt = intr_cnt;
+	intr_set_level (old_level);
+}
+
 /* Timer interrupt handler. */
 static void
 timer_interrupt (struct intr_frame *args UNUSED) {
+	uint64_t start = intr_timing ? rdtsc () : 0;
+
 	ticks++;
 	thread_tick ();
+	thread_awake (ticks);
 
-	if (ticks >= get_next_tick_to_awake()) {
-		thread_awake(ticks);
-	} 
+	if (intr_timing) {
+		intr_cycles += rdtsc () - start;
+		intr_cnt++;
+	}
 }
 
 /* Returns true if LOOPS iterations waits for more than one timer
@@ -190,3 +238,12 @@ real_time_sleep (int64_t num, int32_t denom) {
 		busy_wait (loops_per_tick * num / 1000 * TIMER_FREQ / (denom / 1000));
 	}
 }
+
+/* Busy-wait for approximately NUM/DENOM seconds. */
+static void
+real_time_delay (int64_t num, int32_t denom) {
+	/* Scale the numerator and denominator down by 1000 to avoid
+	   the possibility of overflow. */
+	ASSERT (denom % 1000 == 0);
+	busy_wait (loops_per_tick * num / 1000 * TIMER_FREQ / (denom / 1000));
+}
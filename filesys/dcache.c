@@ -0,0 +1,168 @@
+#include "filesys/dcache.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <string.h>
+#include "filesys/directory.h"
+#include "threads/synch.h"
+
+/* Number of cached directory entries. */
+#define DCACHE_SIZE 256
+
+/* A cached name. */
+struct dentry {
+	struct hash_elem hash_elem;         /* Element in dentries. */
+	struct list_elem lru_elem;          /* Element in lru_list or free_list. */
+	disk_sector_t dir;                  /* Inode sector of the directory. */
+	char name[NAME_MAX + 1];            /* Name within DIR. */
+	bool negative;                      /* True if NAME does not exist. */
+	disk_sector_t sector;               /* Inode sector NAME refers to. */
+};
+
+static struct dentry dentry_pool[DCACHE_SIZE];
+static struct hash dentries;            /* Cached names by (DIR, NAME). */
+static struct list lru_list;            /* Cached names, most recent first. */
+static struct list free_list;           /* Unused entries. */
+static struct lock dcache_lock;
+
+static uint64_t
+dentry_hash (const struct hash_elem *e, void *aux UNUSED) {
+	const struct dentry *d = hash_entry (e, struct dentry, hash_elem);
+	return hash_string (d->name) ^ hash_int (d->dir);
+}
+
+static bool
+dentry_less (const struct hash_elem *a_, const struct hash_elem *b_,
+		void *aux UNUSED) {
+	const struct dentry *a = hash_entry (a_, struct dentry, hash_elem);
+	const struct dentry *b = hash_entry (b_, struct dentry, hash_elem);
+	if (a->dir != b->dir)
+		return a->dir < b->dir;
+	return strcmp (a->name, b->name) < 0;
+}
+
+/* Initializes the directory entry cache. */
+void
+dcache_init (void) {
+	size_t i;
+
+	if (!hash_init (&dentries, dentry_hash, dentry_less, NULL))
+		PANIC ("dcache initialization failed");
+	list_init (&lru_list);
+	list_init (&free_list);
+	for (i = 0; i < DCACHE_SIZE; i++)
+		list_push_back (&free_list, &dentry_pool[i].lru_elem);
+	lock_init (&dcache_lock);
+}
+
+/* Returns the cached entry for NAME in DIR, or a null pointer.
+ * Must be called with dcache_lock held. */
+static struct dentry *
+dcache_find (disk_sector_t dir, const char *name) {
+	struct dentry key;
+	struct hash_elem *e;
+
+	if (strlen (name) > NAME_MAX)
+		return NULL;
+	key.dir = dir;
+	strlcpy (key.name, name, sizeof key.name);
+	e = hash_find (&dentries, &key.hash_elem);
+	return e != NULL ? hash_entry (e, struct dentry, hash_elem) : NULL;
+}
+
+/* Drops D from the cache.  Must be called with dcache_lock held. */
+static void
+dcache_drop (struct dentry *d) {
+	hash_delete (&dentries, &d->hash_elem);
+	list_remove (&d->lru_elem);
+	list_push_back (&free_list, &d->lru_elem);
+}
+
+/* Looks up NAME in directory DIR.  If it is cached, returns true
+ * and sets *FOUND to whether NAME exists and, if so, *SECTOR to its
+ * inode sector.  Returns false if NAME is not cached. */
+bool
+dcache_lookup (disk_sector_t dir, const char *name, bool *found,
+		disk_sector_t *sector) {
+	struct dentry *d;
+
+	lock_acquire (&dcache_lock);
+	d = dcache_find (dir, name);
+	if (d != NULL) {
+		list_remove (&d->lru_elem);
+		list_push_front (&lru_list, &d->lru_elem);
+		*found = !d->negative;
+		*sector = d->sector;
+	}
+	lock_release (&dcache_lock);
+	return d != NULL;
+}
+
+/* Caches that NAME in DIR does or, if NEGATIVE, does not refer to
+ * inode SECTOR, evicting the least recently used entry if the
+ * cache is full. */
+static void
+dcache_store (disk_sector_t dir, const char *name, bool negative,
+		disk_sector_t sector) {
+	struct dentry *d;
+
+	if (strlen (name) > NAME_MAX)
+		return;
+
+	lock_acquire (&dcache_lock);
+	d = dcache_find (dir, name);
+	if (d == NULL) {
+		if (list_empty (&free_list))
+			dcache_drop (list_entry (list_back (&lru_list), struct dentry,
+						lru_elem));
+		d = list_entry (list_pop_front (&free_list), struct dentry, lru_elem);
+		d->dir = dir;
+		strlcpy (d->name, name, sizeof d->name);
+		hash_insert (&dentries, &d->hash_elem);
+	} else
+		list_remove (&d->lru_elem);
+	list_push_front (&lru_list, &d->lru_elem);
+	d->negative = negative;
+	d->sector = sector;
+	lock_release (&dcache_lock);
+}
+
+/* Caches that NAME in DIR refers to inode SECTOR. */
+void
+dcache_insert (disk_sector_t dir, const char *name, disk_sector_t sector) {
+	dcache_store (dir, name, false, sector);
+}
+
+/* Caches that there is no NAME in DIR. */
+void
+dcache_insert_negative (disk_sector_t dir, const char *name) {
+	dcache_store (dir, name, true, 0);
+}
+
+/* Forgets anything cached about NAME in DIR. */
+void
+dcache_invalidate (disk_sector_t dir, const char *name) {
+	struct dentry *d;
+
+	lock_acquire (&dcache_lock);
+	d = dcache_find (dir, name);
+	if (d != NULL)
+		dcache_drop (d);
+	lock_release (&dcache_lock);
+}
+
+/* Forgets every name cached in directory DIR, e.g. because DIR
+ * has been removed and its sector may be reused. */
+void
+dcache_invalidate_dir (disk_sector_t dir) {
+	struct list_elem *e, *next;
+
+	lock_acquire (&dcache_lock);
+	for (e = list_begin (&lru_list); e != list_end (&lru_list); e = next) {
+		struct dentry *d = list_entry (e, struct dentry, lru_elem);
+		next = list_next (e);
+		if (d->dir == dir)
+			dcache_drop (d);
+	}
+	lock_release (&dcache_lock);
+}
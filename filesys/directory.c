@@ -1,15 +1,21 @@
 #include "filesys/directory.h"
 #include <stdio.h>
 #include <string.h>
+#include <hash.h>
 #include <list.h>
+#include "filesys/dcache.h"
 #include "filesys/filesys.h"
+#include "filesys/free-map.h"
 #include "filesys/inode.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
 
 /* A directory. */
 struct dir {
 	struct inode *inode;                /* Backing store. */
 	off_t pos;                          /* Current position. */
+	struct inode *index;                /* Hash index, or null if the
+	                                       directory has none. */
 };
 
 /* A single directory entry. */
@@ -19,11 +25,107 @@ struct dir_entry {
 	bool in_use;                        /* In use or free? */
 };
 
-/* Creates a directory with space for ENTRY_CNT entries in the
- * given SECTOR.  Returns true if successful, false on failure. */
+/* Identifies a directory with a hash index. */
+#define DIR_INDEX_MAGIC 0x44494458
+
+/* Fewest buckets in a hash index. */
+#define DIR_MIN_BUCKETS 16
+
+/* Header in the first entry slot of an indexed directory.  Its
+ * IN_USE is always false, so entry scans skip it, and a directory
+ * without a header is read the old way, by linear search.
+ *
+ * The index is a separate inode holding BUCKET_CNT bucket heads
+ * followed by one link per entry slot.  A head or link holds an
+ * entry slot number, or 0 for the end of the chain; slot 0 is the
+ * header itself.  Entry slots that are not in use are chained
+ * through their links from FREE_HEAD. */
+struct dir_header {
+	uint32_t magic;                     /* DIR_INDEX_MAGIC. */
+	disk_sector_t index;                /* Inode sector of the index. */
+	uint32_t bucket_cnt;                /* Number of hash buckets. */
+	uint32_t free_head;                 /* First free entry slot, or 0. */
+	uint8_t unused[3];                  /* Not used. */
+	bool in_use;                        /* Always false. */
+};
+
+/* Directory layer lock.  Held shared to search or read
+ * directories and exclusive to add or remove entries, which update
+ * an entry, the hash index and the header together. */
+static struct rwlock dir_lock;
+
+/* Initializes the directory layer. */
+void
+dir_init (void) {
+	rwlock_init (&dir_lock);
+}
+
+/* Reads DIR's header into *H.
+ * Returns false if DIR has no hash index. */
+static bool
+read_header (const struct dir *dir, struct dir_header *h) {
+	return dir->index != NULL
+		&& inode_read_at (dir->inode, h, sizeof *h, 0) == sizeof *h;
+}
+
+/* Writes header H back to DIR. */
+static bool
+write_header (struct dir *dir, const struct dir_header *h) {
+	return inode_write_at (dir->inode, h, sizeof *h, 0) == sizeof *h;
+}
+
+/* Returns word I of index INODE. */
+static uint32_t
+index_get (struct inode *index, size_t i) {
+	uint32_t v = 0;
+	inode_read_at (index, &v, sizeof v, i * sizeof v);
+	return v;
+}
+
+/* Sets word I of index INODE to V. */
+static bool
+index_set (struct inode *index, size_t i, uint32_t v) {
+	return inode_write_at (index, &v, sizeof v, i * sizeof v) == sizeof v;
+}
+
+/* Returns the bucket for NAME in an index of BUCKET_CNT buckets. */
+static uint32_t
+name_bucket (const char *name, uint32_t bucket_cnt) {
+	return hash_string (name) % bucket_cnt;
+}
+
+/* Creates a directory in the given SECTOR, with a hash index sized
+ * for about ENTRY_CNT entries.  The directory grows as entries are
+ * added.  Returns true if successful, false on failure. */
 bool
 dir_create (disk_sector_t sector, size_t entry_cnt) {
-	return inode_create (sector, entry_cnt * sizeof (struct dir_entry));
+	struct dir_header h;
+	struct inode *inode;
+	disk_sector_t index_sector = 0;
+	uint32_t bucket_cnt = DIR_MIN_BUCKETS;
+	bool success;
+
+	ASSERT (sizeof h == sizeof (struct dir_entry));
+
+	while (bucket_cnt < entry_cnt)
+		bucket_cnt *= 2;
+	if (!free_map_allocate_near (1, sector, &index_sector))
+		return false;
+	if (!inode_create (index_sector, bucket_cnt * sizeof (uint32_t))
+			|| !inode_create (sector, sizeof h)) {
+		free_map_release (index_sector, 1);
+		return false;
+	}
+
+	memset (&h, 0, sizeof h);
+	h.magic = DIR_INDEX_MAGIC;
+	h.index = index_sector;
+	h.bucket_cnt = bucket_cnt;
+	inode = inode_open (sector);
+	success = inode != NULL
+		&& inode_write_at (inode, &h, sizeof h, 0) == sizeof h;
+	inode_close (inode);
+	return success;
 }
 
 /* Opens and returns the directory for the given INODE, of which
@@ -32,8 +134,14 @@ struct dir *
 dir_open (struct inode *inode) {
 	struct dir *dir = calloc (1, sizeof *dir);
 	if (inode != NULL && dir != NULL) {
+		struct dir_header h;
+
 		dir->inode = inode;
 		dir->pos = 0;
+		dir->index = NULL;
+		if (inode_read_at (inode, &h, sizeof h, 0) == sizeof h
+				&& h.magic == DIR_INDEX_MAGIC && !h.in_use)
+			dir->index = inode_open (h.index);
 		return dir;
 	} else {
 		inode_close (inode);
@@ -60,6 +168,7 @@ dir_reopen (struct dir *dir) {
 void
 dir_close (struct dir *dir) {
 	if (dir != NULL) {
+		inode_close (dir->index);
 		inode_close (dir->inode);
 		free (dir);
 	}
@@ -79,12 +188,32 @@ dir_get_inode (struct dir *dir) {
 static bool
 lookup (const struct dir *dir, const char *name,
 		struct dir_entry *ep, off_t *ofsp) {
+	struct dir_header h;
 	struct dir_entry e;
 	size_t ofs;
 
 	ASSERT (dir != NULL);
 	ASSERT (name != NULL);
 
+	if (read_header (dir, &h)) {
+		/* Walk NAME's hash chain. */
+		uint32_t slot;
+
+		for (slot = index_get (dir->index, name_bucket (name, h.bucket_cnt));
+				slot != 0; slot = index_get (dir->index, h.bucket_cnt + slot)) {
+			ofs = slot * sizeof e;
+			if (inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e
+					&& e.in_use && !strcmp (name, e.name)) {
+				if (ep != NULL)
+					*ep = e;
+				if (ofsp != NULL)
+					*ofsp = ofs;
+				return true;
+			}
+		}
+		return false;
+	}
+
 	for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
 			ofs += sizeof e)
 		if (e.in_use && !strcmp (name, e.name)) {
@@ -100,23 +229,75 @@ lookup (const struct dir *dir, const char *name,
 /* Searches DIR for a file with the given NAME
  * and returns true if one exists, false otherwise.
  * On success, sets *INODE to an inode for the file, otherwise to
- * a null pointer.  The caller must close *INODE. */
+ * a null pointer.  The caller must close *INODE.
+ * Consults the directory entry cache first, and caches the result
+ * of a search, including a failed one. */
 bool
 dir_lookup (const struct dir *dir, const char *name,
 		struct inode **inode) {
+	disk_sector_t parent;
+	disk_sector_t sector;
 	struct dir_entry e;
+	bool found;
 
 	ASSERT (dir != NULL);
 	ASSERT (name != NULL);
 
-	if (lookup (dir, name, &e, NULL))
+	parent = inode_get_inumber (dir->inode);
+
+	rwlock_acquire_read (&dir_lock);
+	if (dcache_lookup (parent, name, &found, &sector))
+		*inode = found ? inode_open (sector) : NULL;
+	else if (lookup (dir, name, &e, NULL)) {
+		dcache_insert (parent, name, e.inode_sector);
 		*inode = inode_open (e.inode_sector);
-	else
+	} else {
+		dcache_insert_negative (parent, name);
 		*inode = NULL;
+	}
+	rwlock_release_read (&dir_lock);
 
 	return *inode != NULL;
 }
 
+/* Rebuilds DIR's hash index with BUCKET_CNT buckets from the
+ * entries themselves, updating header H.
+ * Returns true if successful. */
+static bool
+rebuild_index (struct dir *dir, struct dir_header *h, uint32_t bucket_cnt) {
+	size_t slot_cnt = inode_length (dir->inode) / sizeof (struct dir_entry);
+	size_t word_cnt = bucket_cnt + slot_cnt;
+	uint32_t *words = calloc (word_cnt, sizeof *words);
+	uint32_t *heads = words, *links = words + bucket_cnt;
+	size_t slot;
+	bool success;
+
+	if (words == NULL)
+		return false;
+
+	/* Chain from the back so that chains run in slot order. */
+	h->free_head = 0;
+	for (slot = slot_cnt - 1; slot > 0; slot--) {
+		struct dir_entry e;
+
+		inode_read_at (dir->inode, &e, sizeof e, slot * sizeof e);
+		if (e.in_use) {
+			uint32_t b = name_bucket (e.name, bucket_cnt);
+			links[slot] = heads[b];
+			heads[b] = slot;
+		} else {
+			links[slot] = h->free_head;
+			h->free_head = slot;
+		}
+	}
+	h->bucket_cnt = bucket_cnt;
+
+	success = (inode_write_at (dir->index, words, word_cnt * sizeof *words, 0)
+			== (off_t) (word_cnt * sizeof *words)) && write_header (dir, h);
+	free (words);
+	return success;
+}
+
 /* Adds a file named NAME to DIR, which must not already contain a
  * file by that name.  The file's inode is in sector
  * INODE_SECTOR.
@@ -125,21 +306,57 @@ dir_lookup (const struct dir *dir, const char *name,
  * error occurs. */
 bool
 dir_add (struct dir *dir, const char *name, disk_sector_t inode_sector) {
+	disk_sector_t parent;
+	disk_sector_t sector;
+	struct dir_header h;
 	struct dir_entry e;
 	off_t ofs;
-	bool success = false;
+	bool found, success = false;
 
 	ASSERT (dir != NULL);
 	ASSERT (name != NULL);
 
+	parent = inode_get_inumber (dir->inode);
+
 	/* Check NAME for validity. */
 	if (*name == '\0' || strlen (name) > NAME_MAX)
 		return false;
 
+	rwlock_acquire_write (&dir_lock);
+
 	/* Check that NAME is not in use. */
-	if (lookup (dir, name, NULL, NULL))
+	if (!dcache_lookup (parent, name, &found, &sector))
+		found = lookup (dir, name, NULL, NULL);
+	if (found)
 		goto done;
 
+	if (read_header (dir, &h)) {
+		/* Take a free slot, or append one, and push it on NAME's
+		 * chain. */
+		uint32_t bucket = name_bucket (name, h.bucket_cnt);
+		uint32_t slot = h.free_head;
+
+		if (slot != 0)
+			h.free_head = index_get (dir->index, h.bucket_cnt + slot);
+		else
+			slot = inode_length (dir->inode) / sizeof e;
+
+		e.in_use = true;
+		strlcpy (e.name, name, sizeof e.name);
+		e.inode_sector = inode_sector;
+		success = (inode_write_at (dir->inode, &e, sizeof e, slot * sizeof e)
+				== sizeof e)
+			&& index_set (dir->index, h.bucket_cnt + slot,
+					index_get (dir->index, bucket))
+			&& index_set (dir->index, bucket, slot)
+			&& write_header (dir, &h);
+
+		/* Keep chains short as the directory grows. */
+		if (success && slot > 2 * h.bucket_cnt)
+			rebuild_index (dir, &h, h.bucket_cnt * 2);
+		goto done;
+	}
+
 	/* Set OFS to offset of free slot.
 	 * If there are no free slots, then it will be set to the
 	 * current end-of-file.
@@ -159,14 +376,47 @@ dir_add (struct dir *dir, const char *name, disk_sector_t inode_sector) {
 	success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
 
 done:
+	if (success)
+		dcache_insert (parent, name, inode_sector);
+	else
+		dcache_invalidate (parent, name);
+	rwlock_release_write (&dir_lock);
 	return success;
 }
 
+/* Unlinks the entry in slot SLOT, named NAME, from the hash chain
+ * of DIR with header H and puts the slot on the free list.
+ * Returns true if successful. */
+static bool
+index_remove (struct dir *dir, struct dir_header *h, const char *name,
+		uint32_t slot) {
+	uint32_t bucket = name_bucket (name, h->bucket_cnt);
+	uint32_t next = index_get (dir->index, h->bucket_cnt + slot);
+	uint32_t prev = 0, cur;
+
+	for (cur = index_get (dir->index, bucket); cur != slot;
+			cur = index_get (dir->index, h->bucket_cnt + cur)) {
+		if (cur == 0)
+			return false;
+		prev = cur;
+	}
+
+	if (!(prev == 0
+				? index_set (dir->index, bucket, next)
+				: index_set (dir->index, h->bucket_cnt + prev, next)))
+		return false;
+	if (!index_set (dir->index, h->bucket_cnt + slot, h->free_head))
+		return false;
+	h->free_head = slot;
+	return write_header (dir, h);
+}
+
 /* Removes any entry for NAME in DIR.
  * Returns true if successful, false on failure,
  * which occurs only if there is no file with the given NAME. */
 bool
 dir_remove (struct dir *dir, const char *name) {
+	struct dir_header h;
 	struct dir_entry e;
 	struct inode *inode = NULL;
 	bool success = false;
@@ -175,6 +425,8 @@ dir_remove (struct dir *dir, const char *name) {
 	ASSERT (dir != NULL);
 	ASSERT (name != NULL);
 
+	rwlock_acquire_write (&dir_lock);
+
 	/* Find directory entry. */
 	if (!lookup (dir, name, &e, &ofs))
 		goto done;
@@ -189,11 +441,22 @@ dir_remove (struct dir *dir, const char *name) {
 	if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e)
 		goto done;
 
-	/* Remove inode. */
+	/* The name is gone from disk, so it must not stay cached even
+	 * if updating the index fails. */
+	dcache_invalidate (inode_get_inumber (dir->inode), name);
+	if (read_header (dir, &h)
+			&& !index_remove (dir, &h, name, ofs / sizeof e))
+		goto done;
+
+	/* Remove inode.  If it was a directory, names cached in it
+	 * must not outlive it. */
 	inode_remove (inode);
+	dcache_insert_negative (inode_get_inumber (dir->inode), name);
+	dcache_invalidate_dir (e.inode_sector);
 	success = true;
 
 done:
+	rwlock_release_write (&dir_lock);
 	inode_close (inode);
 	return success;
 }
@@ -204,13 +467,17 @@ done:
 bool
 dir_readdir (struct dir *dir, char name[NAME_MAX + 1]) {
 	struct dir_entry e;
+	bool found = false;
 
+	rwlock_acquire_read (&dir_lock);
 	while (inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e) {
 		dir->pos += sizeof e;
 		if (e.in_use) {
 			strlcpy (name, e.name, NAME_MAX + 1);
-			return true;
+			found = true;
+			break;
 		}
 	}
-	return false;
+	rwlock_release_read (&dir_lock);
+	return found;
 }
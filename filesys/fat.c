@@ -1,6 +1,9 @@
 #include "filesys/fat.h"
+#include <bitmap.h>
+#include <round.h>
 #include "devices/disk.h"
 #include "filesys/filesys.h"
+#include "filesys/page_cache.h"
 #include "threads/malloc.h"
 #include "threads/synch.h"
 #include <stdio.h>
@@ -24,12 +27,40 @@ struct fat_fs {
 	disk_sector_t data_start;
 	cluster_t last_clst;
 	struct lock write_lock;
+	struct bitmap *used;      /* One bit per cluster, set if allocated. */
+	size_t free_cnt;          /* Number of clear bits in USED. */
+	uint16_t *region_free;    /* Clear bits in each region of USED. */
+	size_t region_cnt;        /* Number of regions. */
 };
 
+/* Clusters per region of the free-cluster summary.  Allocation
+ * skips regions whose summary count is zero without looking at
+ * their bits. */
+#define FAT_REGION_CLUSTERS 1024
+
 static struct fat_fs *fat_fs;
 
+/* Chain lookup cache.
+ * Remembers, for the chain starting at START, which cluster is
+ * the IDX'th one, for IDX a multiple of FAT_LOOKUP_STRIDE.  A
+ * lookup then walks fewer than FAT_LOOKUP_STRIDE links from the
+ * nearest remembered position instead of from the chain start.
+ * Entries are direct-mapped by hashing (START, IDX). */
+#define FAT_LOOKUP_CNT 256
+#define FAT_LOOKUP_STRIDE 8
+
+struct fat_lookup {
+	cluster_t start;          /* First cluster of the chain, 0 if empty. */
+	size_t idx;               /* Position within the chain. */
+	cluster_t clst;           /* Cluster at position IDX. */
+};
+
+static struct fat_lookup fat_lookup_cache[FAT_LOOKUP_CNT];
+
 void fat_boot_create (void);
 void fat_fs_init (void);
+static void fat_build_used_map (void);
+static void fat_mark_used (cluster_t clst);
 
 void
 fat_init (void) {
@@ -41,7 +72,7 @@ fat_init (void) {
 	unsigned int *bounce = malloc (DISK_SECTOR_SIZE);
 	if (bounce == NULL)
 		PANIC ("FAT init failed");
-	disk_read (filesys_disk, FAT_BOOT_SECTOR, bounce);
+	page_cache_read (FAT_BOOT_SECTOR, bounce, 0, DISK_SECTOR_SIZE);
 	memcpy (&fat_fs->bs, bounce, sizeof (fat_fs->bs));
 	free (bounce);
 
@@ -53,11 +84,12 @@ fat_init (void) {
 
 void
 fat_open (void) {
+	free (fat_fs->fat);
 	fat_fs->fat = calloc (fat_fs->fat_length, sizeof (cluster_t));
 	if (fat_fs->fat == NULL)
 		PANIC ("FAT load failed");
 
-	// Load FAT directly from the disk
+	// Load FAT through the buffer cache
 	uint8_t *buffer = (uint8_t *) fat_fs->fat;
 	off_t bytes_read = 0;
 	off_t bytes_left = sizeof (fat_fs->fat);
@@ -65,19 +97,21 @@ fat_open (void) {
 	for (unsigned i = 0; i < fat_fs->bs.fat_sectors; i++) {
 		bytes_left = fat_size_in_bytes - bytes_read;
 		if (bytes_left >= DISK_SECTOR_SIZE) {
-			disk_read (filesys_disk, fat_fs->bs.fat_start + i,
-			           buffer + bytes_read);
+			page_cache_read (fat_fs->bs.fat_start + i,
+			                 buffer + bytes_read, 0, DISK_SECTOR_SIZE);
 			bytes_read += DISK_SECTOR_SIZE;
 		} else {
 			uint8_t *bounce = malloc (DISK_SECTOR_SIZE);
 			if (bounce == NULL)
 				PANIC ("FAT load failed");
-			disk_read (filesys_disk, fat_fs->bs.fat_start + i, bounce);
+			page_cache_read (fat_fs->bs.fat_start + i, bounce, 0, DISK_SECTOR_SIZE);
 			memcpy (buffer + bytes_read, bounce, bytes_left);
 			bytes_read += bytes_left;
 			free (bounce);
 		}
 	}
+
+	fat_build_used_map ();
 }
 
 void
@@ -87,10 +121,10 @@ fat_close (void) {
 	if (bounce == NULL)
 		PANIC ("FAT close failed");
 	memcpy (bounce, &fat_fs->bs, sizeof (fat_fs->bs));
-	disk_write (filesys_disk, FAT_BOOT_SECTOR, bounce);
+	page_cache_write (FAT_BOOT_SECTOR, bounce, 0, DISK_SECTOR_SIZE);
 	free (bounce);
 
-	// Write FAT directly to the disk
+	// Write FAT through the buffer cache
 	uint8_t *buffer = (uint8_t *) fat_fs->fat;
 	off_t bytes_wrote = 0;
 	off_t bytes_left = sizeof (fat_fs->fat);
@@ -98,15 +132,15 @@ fat_close (void) {
 	for (unsigned i = 0; i < fat_fs->bs.fat_sectors; i++) {
 		bytes_left = fat_size_in_bytes - bytes_wrote;
 		if (bytes_left >= DISK_SECTOR_SIZE) {
-			disk_write (filesys_disk, fat_fs->bs.fat_start + i,
-			            buffer + bytes_wrote);
+			page_cache_write (fat_fs->bs.fat_start + i,
+			                  buffer + bytes_wrote, 0, DISK_SECTOR_SIZE);
 			bytes_wrote += DISK_SECTOR_SIZE;
 		} else {
 			bounce = calloc (1, DISK_SECTOR_SIZE);
 			if (bounce == NULL)
 				PANIC ("FAT close failed");
 			memcpy (bounce, buffer + bytes_wrote, bytes_left);
-			disk_write (filesys_disk, fat_fs->bs.fat_start + i, bounce);
+			page_cache_write (fat_fs->bs.fat_start + i, bounce, 0, DISK_SECTOR_SIZE);
 			bytes_wrote += bytes_left;
 			free (bounce);
 		}
@@ -125,13 +159,16 @@ fat_create (void) {
 		PANIC ("FAT creation failed");
 
 	// Set up ROOT_DIR_CLST
+	fat_build_used_map ();
 	fat_put (ROOT_DIR_CLUSTER, EOChain);
+	fat_mark_used (ROOT_DIR_CLUSTER);
 
 	// Fill up ROOT_DIR_CLUSTER region with 0
 	uint8_t *buf = calloc (1, DISK_SECTOR_SIZE);
 	if (buf == NULL)
 		PANIC ("FAT create failed due to OOM");
-	disk_write (filesys_disk, cluster_to_sector (ROOT_DIR_CLUSTER), buf);
+	page_cache_write (cluster_to_sector (ROOT_DIR_CLUSTER), buf, 0,
+			DISK_SECTOR_SIZE);
 	free (buf);
 }
 
@@ -152,42 +189,217 @@ fat_boot_create (void) {
 
 void
 fat_fs_init (void) {
-	/* TODO: Your code goes here. */
+	/* Cluster 0 is never allocated, so that a FAT entry of 0 can
+	 * mean "free"; cluster 1 is the first data cluster. */
+	fat_fs->data_start = fat_fs->bs.fat_start + fat_fs->bs.fat_sectors;
+	fat_fs->fat_length = (fat_fs->bs.total_sectors - fat_fs->data_start)
+		/ SECTORS_PER_CLUSTER + 1;
+	fat_fs->last_clst = ROOT_DIR_CLUSTER;
+	lock_init (&fat_fs->write_lock);
+}
+
+/* Builds the allocation bitmap and its per-region summary from
+ * the FAT, which must already be in memory. */
+static void
+fat_build_used_map (void) {
+	cluster_t clst;
+	size_t r;
+
+	if (fat_fs->used != NULL)
+		bitmap_destroy (fat_fs->used);
+	free (fat_fs->region_free);
+	fat_fs->used = bitmap_create (fat_fs->fat_length);
+	fat_fs->region_cnt = DIV_ROUND_UP (fat_fs->fat_length,
+			FAT_REGION_CLUSTERS);
+	fat_fs->region_free = malloc (fat_fs->region_cnt
+			* sizeof *fat_fs->region_free);
+	if (fat_fs->used == NULL || fat_fs->region_free == NULL)
+		PANIC ("FAT bitmap creation failed");
+	bitmap_mark (fat_fs->used, 0);
+	for (clst = 1; clst < fat_fs->fat_length; clst++)
+		if (fat_fs->fat[clst] != 0)
+			bitmap_mark (fat_fs->used, clst);
+
+	fat_fs->free_cnt = 0;
+	for (r = 0; r < fat_fs->region_cnt; r++) {
+		size_t base = r * FAT_REGION_CLUSTERS;
+		size_t cnt = fat_fs->fat_length - base < FAT_REGION_CLUSTERS
+			? fat_fs->fat_length - base : FAT_REGION_CLUSTERS;
+
+		fat_fs->region_free[r] = bitmap_count (fat_fs->used, base, cnt,
+				false);
+		fat_fs->free_cnt += fat_fs->region_free[r];
+	}
+}
+
+/* Marks free cluster CLST allocated.  Caller must hold the write
+ * lock, except while the file system is being created. */
+static void
+fat_mark_used (cluster_t clst) {
+	ASSERT (!bitmap_test (fat_fs->used, clst));
+	bitmap_mark (fat_fs->used, clst);
+	fat_fs->free_cnt--;
+	fat_fs->region_free[clst / FAT_REGION_CLUSTERS]--;
+}
+
+/* Returns the first free cluster at or after START, wrapping
+ * around to the start of the FAT, or 0 if every cluster is in
+ * use.  Regions the summary shows to be full are skipped.
+ * Caller must hold the write lock. */
+static cluster_t
+fat_find_free (cluster_t start) {
+	size_t first = start / FAT_REGION_CLUSTERS;
+	size_t i;
+
+	if (fat_fs->free_cnt == 0)
+		return 0;
+
+	/* The region START is in comes up twice: first from START,
+	 * and again from its beginning after wrapping around. */
+	for (i = 0; i <= fat_fs->region_cnt; i++) {
+		size_t r = (first + i) % fat_fs->region_cnt;
+		size_t base = r * FAT_REGION_CLUSTERS;
+		size_t clst;
+
+		if (fat_fs->region_free[r] == 0)
+			continue;
+		clst = bitmap_scan (fat_fs->used, i == 0 ? start : base, 1, false);
+		if (clst != BITMAP_ERROR && clst < base + FAT_REGION_CLUSTERS)
+			return clst;
+	}
+	return 0;
 }
 
 /*----------------------------------------------------------------------------*/
 /* FAT handling                                                               */
 /*----------------------------------------------------------------------------*/
 
+/* Returns the lookup cache slot for position IDX of the chain
+ * starting at START. */
+static struct fat_lookup *
+fat_lookup_slot (cluster_t start, size_t idx) {
+	return &fat_lookup_cache[(start * 31 + idx / FAT_LOOKUP_STRIDE)
+		% FAT_LOOKUP_CNT];
+}
+
 /* Add a cluster to the chain.
  * If CLST is 0, start a new chain.
  * Returns 0 if fails to allocate a new cluster. */
 cluster_t
 fat_create_chain (cluster_t clst) {
-	/* TODO: Your code goes here. */
+	cluster_t new;
+
+	ASSERT (clst < fat_fs->fat_length);
+
+	lock_acquire (&fat_fs->write_lock);
+	/* Allocate next-fit from the last allocation, so that a file
+	 * grown one cluster at a time stays contiguous. */
+	new = fat_find_free (fat_fs->last_clst);
+	if (new == 0) {
+		lock_release (&fat_fs->write_lock);
+		return 0;
+	}
+	fat_mark_used (new);
+	fat_fs->last_clst = new;
+	fat_fs->fat[new] = EOChain;
+	if (clst != 0)
+		fat_fs->fat[clst] = new;
+	lock_release (&fat_fs->write_lock);
+	return new;
 }
 
 /* Remove the chain of clusters starting from CLST.
  * If PCLST is 0, assume CLST as the start of the chain. */
 void
 fat_remove_chain (cluster_t clst, cluster_t pclst) {
-	/* TODO: Your code goes here. */
+	lock_acquire (&fat_fs->write_lock);
+	if (pclst != 0)
+		fat_fs->fat[pclst] = EOChain;
+	while (clst != 0 && clst != EOChain) {
+		cluster_t next;
+
+		ASSERT (clst < fat_fs->fat_length);
+		ASSERT (bitmap_test (fat_fs->used, clst));
+		next = fat_fs->fat[clst];
+		fat_fs->fat[clst] = 0;
+		bitmap_reset (fat_fs->used, clst);
+		fat_fs->free_cnt++;
+		fat_fs->region_free[clst / FAT_REGION_CLUSTERS]++;
+		clst = next;
+	}
+
+	/* The removed clusters may be remembered under any chain start,
+	 * including the start of a chain truncated at PCLST. */
+	memset (fat_lookup_cache, 0, sizeof fat_lookup_cache);
+	lock_release (&fat_fs->write_lock);
 }
 
 /* Update a value in the FAT table. */
 void
 fat_put (cluster_t clst, cluster_t val) {
-	/* TODO: Your code goes here. */
+	ASSERT (clst != 0 && clst < fat_fs->fat_length);
+	fat_fs->fat[clst] = val;
 }
 
 /* Fetch a value in the FAT table. */
 cluster_t
 fat_get (cluster_t clst) {
-	/* TODO: Your code goes here. */
+	ASSERT (clst != 0 && clst < fat_fs->fat_length);
+	return fat_fs->fat[clst];
+}
+
+/* Returns the IDX'th cluster (counting from 0) of the chain that
+ * starts at START, or 0 if the chain is shorter than that. */
+cluster_t
+fat_chain_nth (cluster_t start, size_t idx) {
+	size_t base = idx - idx % FAT_LOOKUP_STRIDE;
+	size_t pos = 0;
+	cluster_t clst = start;
+
+	ASSERT (start != 0);
+
+	lock_acquire (&fat_fs->write_lock);
+	/* Find the closest remembered position at or before IDX. */
+	for (;; base -= FAT_LOOKUP_STRIDE) {
+		struct fat_lookup *l = fat_lookup_slot (start, base);
+		if (l->start == start && l->idx == base) {
+			pos = base;
+			clst = l->clst;
+			break;
+		}
+		if (base == 0)
+			break;
+	}
+
+	/* Walk the rest, remembering the stride positions passed. */
+	while (pos < idx && clst != EOChain) {
+		clst = fat_fs->fat[clst];
+		pos++;
+		if (pos % FAT_LOOKUP_STRIDE == 0 && clst != EOChain)
+			*fat_lookup_slot (start, pos) = (struct fat_lookup) {
+				.start = start, .idx = pos, .clst = clst };
+	}
+	lock_release (&fat_fs->write_lock);
+	return clst == EOChain ? 0 : clst;
+}
+
+/* Returns the number of free clusters. */
+size_t
+fat_free_cnt (void) {
+	return fat_fs->free_cnt;
 }
 
 /* Covert a cluster # to a sector number. */
 disk_sector_t
 cluster_to_sector (cluster_t clst) {
-	/* TODO: Your code goes here. */
+	ASSERT (clst != 0 && clst < fat_fs->fat_length);
+	return fat_fs->data_start + (clst - 1) * SECTORS_PER_CLUSTER;
+}
+
+/* Converts sector SECTOR, which must lie in the data area, to the
+ * number of the cluster that contains it. */
+cluster_t
+sector_to_cluster (disk_sector_t sector) {
+	ASSERT (sector >= fat_fs->data_start);
+	return (sector - fat_fs->data_start) / SECTORS_PER_CLUSTER + 1;
 }
@@ -8,6 +8,7 @@ struct file {
 	struct inode *inode;        /* File's inode. */
 	off_t pos;                  /* Current position. */
 	bool deny_write;            /* Has file_deny_write() been called? */
+	bool direct;                /* Has file_set_direct() been called? */
 };
 
 /* Opens a file for the given INODE, of which it takes ownership,
@@ -20,6 +21,7 @@ file_open (struct inode *inode) {
 		file->inode = inode;
 		file->pos = 0;
 		file->deny_write = false;
+		file->direct = false;
 		return file;
 	} else {
 		inode_close (inode);
@@ -42,6 +44,7 @@ file_duplicate (struct file *file) {
 	struct file *nfile = file_open (inode_reopen (file->inode));
 	if (nfile) {
 		nfile->pos = file->pos;
+		nfile->direct = file->direct;
 		if (file->deny_write)
 			file_deny_write (nfile);
 	}
@@ -76,6 +79,27 @@ file_read (struct file *file, void *buffer, off_t size) {
 	return bytes_read;
 }
 
+/* Like file_read(), but moves whole sectors that are not cached
+ * straight from disk into BUFFER, which must not fault. */
+off_t
+file_read_direct (struct file *file, void *buffer, off_t size) {
+	off_t bytes_read = inode_read_direct (file->inode, buffer, size, file->pos);
+	file->pos += bytes_read;
+	return bytes_read;
+}
+
+/* Reads from FILE into the CNT buffers of IOV in turn, starting
+ * at the file's current position, as a single read.
+ * Returns the total number of bytes read,
+ * which may be less than the buffers' total if end of file is reached.
+ * Advances FILE's position by the number of bytes read. */
+off_t
+file_readv (struct file *file, const struct iovec *iov, size_t cnt) {
+	off_t bytes_read = inode_readv (file->inode, iov, cnt, file->pos);
+	file->pos += bytes_read;
+	return bytes_read;
+}
+
 /* Reads SIZE bytes from FILE into BUFFER,
  * starting at offset FILE_OFS in the file.
  * Returns the number of bytes actually read,
@@ -83,6 +107,8 @@ file_read (struct file *file, void *buffer, off_t size) {
  * The file's current position is unaffected. */
 off_t
 file_read_at (struct file *file, void *buffer, off_t size, off_t file_ofs) {
+	if (file->direct)
+		return inode_read_direct (file->inode, buffer, size, file_ofs);
 	return inode_read_at (file->inode, buffer, size, file_ofs);
 }
 
@@ -100,6 +126,37 @@ file_write (struct file *file, const void *buffer, off_t size) {
 	return bytes_written;
 }
 
+/* Like file_write(), but moves whole sectors that are not cached
+ * straight from BUFFER to disk.  BUFFER must not fault. */
+off_t
+file_write_direct (struct file *file, const void *buffer, off_t size) {
+	off_t bytes_written = inode_write_direct (file->inode, buffer, size,
+			file->pos);
+	file->pos += bytes_written;
+	return bytes_written;
+}
+
+/* Gives the holes in the SIZE bytes of FILE starting at FILE_OFS,
+ * which must lie within its length, disk sectors, so that writing
+ * those bytes later never has to allocate.
+ * Returns true if successful, false if the disk is full. */
+bool
+file_fill (struct file *file, off_t size, off_t file_ofs) {
+	return inode_fill (file->inode, file_ofs, size);
+}
+
+/* Writes the CNT buffers of IOV in turn into FILE, starting at
+ * the file's current position, as a single write.
+ * Returns the total number of bytes actually written,
+ * which may be less than the buffers' total if the disk is full.
+ * Advances FILE's position by the number of bytes written. */
+off_t
+file_writev (struct file *file, const struct iovec *iov, size_t cnt) {
+	off_t bytes_written = inode_writev (file->inode, iov, cnt, file->pos);
+	file->pos += bytes_written;
+	return bytes_written;
+}
+
 /* Writes SIZE bytes from BUFFER into FILE,
  * starting at offset FILE_OFS in the file.
  * Returns the number of bytes actually written,
@@ -110,9 +167,20 @@ file_write (struct file *file, const void *buffer, off_t size) {
 off_t
 file_write_at (struct file *file, const void *buffer, off_t size,
 		off_t file_ofs) {
+	if (file->direct)
+		return inode_write_direct (file->inode, buffer, size, file_ofs);
 	return inode_write_at (file->inode, buffer, size, file_ofs);
 }
 
+/* Makes file_read_at() and file_write_at() on FILE move whole
+ * sectors that are not cached straight between the caller's buffer
+ * and disk, in as few disk commands as possible, rather than one by
+ * one through the buffer cache.  Their buffers must not fault. */
+void
+file_set_direct (struct file *file) {
+	file->direct = true;
+}
+
 /* Prevents write operations on FILE's underlying inode
  * until file_allow_write() is called or FILE is closed. */
 void
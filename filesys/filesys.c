@@ -2,10 +2,12 @@
 #include <debug.h>
 #include <stdio.h>
 #include <string.h>
+#include "filesys/dcache.h"
 #include "filesys/file.h"
 #include "filesys/free-map.h"
 #include "filesys/inode.h"
 #include "filesys/directory.h"
+#include "filesys/page_cache.h"
 #include "devices/disk.h"
 
 /* The disk that contains the file system. */
@@ -21,7 +23,15 @@ filesys_init (bool format) {
 	if (filesys_disk == NULL)
 		PANIC ("hd0:1 (hdb) not present, file system initialization failed");
 
+#ifndef EFILESYS
+	/* Before the buffer cache starts its write-behind thread, which
+	 * flushes the free map. */
+	free_map_init ();
+#endif
+	page_cache_init ();
 	inode_init ();
+	dir_init ();
+	dcache_init ();
 
 #ifdef EFILESYS
 	fat_init ();
@@ -32,8 +42,6 @@ filesys_init (bool format) {
 	fat_open ();
 #else
 	/* Original FS */
-	free_map_init ();
-
 	if (format)
 		do_format ();
 
@@ -51,6 +59,7 @@ filesys_done (void) {
 #else
 	free_map_close ();
 #endif
+	page_cache_flush ();
 }
 
 /* Creates a file named NAME with the given INITIAL_SIZE.
@@ -62,7 +71,8 @@ filesys_create (const char *name, off_t initial_size) {
 	disk_sector_t inode_sector = 0;
 	struct dir *dir = dir_open_root ();
 	bool success = (dir != NULL
-			&& free_map_allocate (1, &inode_sector)
+			&& free_map_allocate_near (1, inode_get_inumber (dir_get_inode (dir)),
+				&inode_sector)
 			&& inode_create (inode_sector, initial_size)
 			&& dir_add (dir, name, inode_sector));
 	if (!success && inode_sector != 0)
@@ -110,6 +120,8 @@ do_format (void) {
 #ifdef EFILESYS
 	/* Create FAT and save it to the disk. */
 	fat_create ();
+	if (!dir_create (ROOT_DIR_SECTOR, 16))
+		PANIC ("root directory creation failed");
 	fat_close ();
 #else
 	free_map_create ();
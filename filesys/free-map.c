@@ -1,21 +1,282 @@
 #include "filesys/free-map.h"
 #include <bitmap.h>
 #include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <round.h>
+#include "filesys/fat.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
 
 static struct file *free_map_file;   /* Free map file. */
 static struct bitmap *free_map;      /* Free map, one bit per disk sector. */
+static struct lock free_map_lock;    /* Protects everything here.  With
+                                        EFILESYS the FAT locks itself. */
+
+/* Number of free map bits in one sector of the free map file. */
+#define BITS_PER_SECTOR (DISK_SECTOR_SIZE * 8)
+
+/* Sectors of the free map file changed since they were last
+ * written, one bit per sector.  free_map_flush() writes them. */
+static struct bitmap *dirty_map;
+
+#ifndef EFILESYS
+/* A maximal run of free sectors.
+ *
+ * Every free run is kept in three places: in BY_START under its
+ * first sector, in BY_END under the sector just past it, so that
+ * a release can merge with its neighbors, and on the size class
+ * list for its length, so that an allocation finds a run that fits
+ * without scanning the bitmap.  Size class C holds runs of 2**C up
+ * to 2**(C+1) - 1 sectors, except that the last class holds all
+ * longer runs too. */
+struct free_run {
+	struct hash_elem start_elem;        /* Element in BY_START. */
+	struct hash_elem end_elem;          /* Element in BY_END. */
+	struct list_elem class_elem;        /* Element in a size class list. */
+	disk_sector_t start;                /* First free sector. */
+	size_t length;                      /* Number of free sectors. */
+};
+
+#define CLASS_CNT 16
+
+/* Most runs of one size class looked at for an allocation, so that
+ * a badly fragmented disk does not make allocation slow. */
+#define SCAN_MAX 32
+
+static struct hash by_start;
+static struct hash by_end;
+static struct list classes[CLASS_CNT];
+
+/* Returns the size class of runs LENGTH sectors long. */
+static size_t
+size_class (size_t length) {
+	size_t c = 0;
+
+	ASSERT (length > 0);
+	while (c + 1 < CLASS_CNT && length >> (c + 1) != 0)
+		c++;
+	return c;
+}
+
+static uint64_t
+run_start_hash (const struct hash_elem *e, void *aux UNUSED) {
+	return hash_int (hash_entry (e, struct free_run, start_elem)->start);
+}
+
+static bool
+run_start_less (const struct hash_elem *a, const struct hash_elem *b,
+		void *aux UNUSED) {
+	return hash_entry (a, struct free_run, start_elem)->start
+		< hash_entry (b, struct free_run, start_elem)->start;
+}
+
+static disk_sector_t
+run_end (const struct free_run *r) {
+	return r->start + r->length;
+}
+
+static uint64_t
+run_end_hash (const struct hash_elem *e, void *aux UNUSED) {
+	return hash_int (run_end (hash_entry (e, struct free_run, end_elem)));
+}
+
+static bool
+run_end_less (const struct hash_elem *a, const struct hash_elem *b,
+		void *aux UNUSED) {
+	return run_end (hash_entry (a, struct free_run, end_elem))
+		< run_end (hash_entry (b, struct free_run, end_elem));
+}
+
+/* Returns the free run that starts at SECTOR, or a null pointer. */
+static struct free_run *
+run_starting_at (disk_sector_t sector) {
+	struct free_run key;
+	struct hash_elem *e;
+
+	key.start = sector;
+	e = hash_find (&by_start, &key.start_elem);
+	return e != NULL ? hash_entry (e, struct free_run, start_elem) : NULL;
+}
+
+/* Returns the free run that ends just before SECTOR, or a null
+ * pointer. */
+static struct free_run *
+run_ending_at (disk_sector_t sector) {
+	struct free_run key;
+	struct hash_elem *e;
+
+	key.start = sector;
+	key.length = 0;
+	e = hash_find (&by_end, &key.end_elem);
+	return e != NULL ? hash_entry (e, struct free_run, end_elem) : NULL;
+}
+
+/* Adds R, whose START and LENGTH are set, to the summary. */
+static void
+run_insert (struct free_run *r) {
+	hash_insert (&by_start, &r->start_elem);
+	hash_insert (&by_end, &r->end_elem);
+	list_push_front (&classes[size_class (r->length)], &r->class_elem);
+}
+
+/* Removes R from the summary without freeing it. */
+static void
+run_remove (struct free_run *r) {
+	hash_delete (&by_start, &r->start_elem);
+	hash_delete (&by_end, &r->end_elem);
+	list_remove (&r->class_elem);
+}
+
+/* Sets bits START through START + CNT of the free map to VALUE and
+ * marks the free map sectors holding them dirty. */
+static void
+set_sectors (disk_sector_t start, size_t cnt, bool value) {
+	size_t first = start / BITS_PER_SECTOR;
+	size_t last = (start + cnt - 1) / BITS_PER_SECTOR;
+
+	bitmap_set_multiple (free_map, start, cnt, value);
+	bitmap_set_multiple (dirty_map, first, last - first + 1, true);
+}
+
+/* Takes CNT sectors out of free run R, which must be at least that
+ * long, from whichever end is closer to HINT.  Returns the first
+ * sector taken. */
+static disk_sector_t
+run_take (struct free_run *r, size_t cnt, disk_sector_t hint) {
+	disk_sector_t sector;
+
+	ASSERT (cnt > 0 && cnt <= r->length);
+
+	run_remove (r);
+	if (hint >= run_end (r)) {
+		sector = run_end (r) - cnt;
+		r->length -= cnt;
+	} else {
+		sector = r->start;
+		r->start += cnt;
+		r->length -= cnt;
+	}
+	if (r->length > 0)
+		run_insert (r);
+	else
+		free (r);
+
+	set_sectors (sector, cnt, true);
+	return sector;
+}
+
+/* Returns the distance between sector HINT and run R. */
+static size_t
+run_distance (const struct free_run *r, disk_sector_t hint) {
+	if (hint < r->start)
+		return r->start - hint;
+	if (hint >= run_end (r))
+		return hint - run_end (r) + 1;
+	return 0;
+}
+
+/* Returns the run to allocate CNT sectors from: among the runs in
+ * the smallest size class that has one long enough, the one
+ * closest to HINT of the first SCAN_MAX.  Returns a null pointer
+ * if no run is CNT sectors long. */
+static struct free_run *
+run_find (size_t cnt, disk_sector_t hint) {
+	size_t c;
+
+	for (c = size_class (cnt); c < CLASS_CNT; c++) {
+		struct free_run *best = NULL;
+		struct list_elem *e;
+		size_t n = 0;
+
+		for (e = list_begin (&classes[c]);
+				e != list_end (&classes[c]) && n < SCAN_MAX; e = list_next (e)) {
+			struct free_run *r = list_entry (e, struct free_run, class_elem);
+			if (r->length < cnt)
+				continue;
+			n++;
+			if (best == NULL || run_distance (r, hint) < run_distance (best, hint))
+				best = r;
+		}
+		if (best != NULL)
+			return best;
+	}
+	return NULL;
+}
+
+/* Returns the longest free run, or a null pointer if the disk is
+ * full. */
+static struct free_run *
+run_longest (void) {
+	struct free_run *best = NULL;
+	size_t c;
+
+	for (c = CLASS_CNT; c-- > 0 && best == NULL; ) {
+		struct list_elem *e;
+
+		for (e = list_begin (&classes[c]); e != list_end (&classes[c]);
+				e = list_next (e)) {
+			struct free_run *r = list_entry (e, struct free_run, class_elem);
+			if (best == NULL || r->length > best->length)
+				best = r;
+		}
+	}
+	return best;
+}
+
+/* Frees the run that E is the BY_START element of. */
+static void
+run_free (struct hash_elem *e, void *aux UNUSED) {
+	free (hash_entry (e, struct free_run, start_elem));
+}
+
+/* Rebuilds the free run summary from the free map. */
+static void
+build_summary (void) {
+	size_t start = 0;
+	size_t length;
+	size_t c;
+
+	hash_clear (&by_end, NULL);
+	hash_clear (&by_start, run_free);
+	for (c = 0; c < CLASS_CNT; c++)
+		list_init (&classes[c]);
+
+	while ((start = bitmap_scan_run (free_map, start, false, &length))
+			!= BITMAP_ERROR) {
+		struct free_run *r = malloc (sizeof *r);
+
+		if (r == NULL)
+			PANIC ("out of memory for the free map summary");
+		r->start = start;
+		r->length = length;
+		run_insert (r);
+		start += length;
+	}
+}
+#endif
 
 /* Initializes the free map. */
 void
 free_map_init (void) {
+	lock_init (&free_map_lock);
 	free_map = bitmap_create (disk_size (filesys_disk));
 	if (free_map == NULL)
 		PANIC ("bitmap creation failed--disk is too large");
+	dirty_map = bitmap_create (DIV_ROUND_UP (bitmap_size (free_map),
+				BITS_PER_SECTOR));
+	if (dirty_map == NULL)
+		PANIC ("bitmap creation failed--disk is too large");
 	bitmap_mark (free_map, FREE_MAP_SECTOR);
 	bitmap_mark (free_map, ROOT_DIR_SECTOR);
+#ifndef EFILESYS
+	hash_init (&by_start, run_start_hash, run_start_less, NULL);
+	hash_init (&by_end, run_end_hash, run_end_less, NULL);
+	build_summary ();
+#endif
 }
 
 /* Allocates CNT consecutive sectors from the free map and stores
@@ -24,40 +285,196 @@ free_map_init (void) {
  * available. */
 bool
 free_map_allocate (size_t cnt, disk_sector_t *sectorp) {
-	disk_sector_t sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
-	if (sector != BITMAP_ERROR
-			&& free_map_file != NULL
-			&& !bitmap_write (free_map, free_map_file)) {
-		bitmap_set_multiple (free_map, sector, cnt, false);
-		sector = BITMAP_ERROR;
+	return free_map_allocate_near (cnt, 0, sectorp);
+}
+
+/* Like free_map_allocate(), but places the sectors as close to
+ * sector HINT as it can.  Among the free runs long enough, those
+ * closest to CNT sectors are preferred, so that long runs are kept
+ * for large files. */
+#ifdef EFILESYS
+bool
+free_map_allocate_near (size_t cnt, disk_sector_t hint UNUSED,
+		disk_sector_t *sectorp) {
+	/* File data lives in FAT chains; only single sectors, such as
+	 * inodes, are allocated here, one cluster each. */
+	cluster_t clst;
+
+	ASSERT (cnt <= SECTORS_PER_CLUSTER);
+	clst = fat_create_chain (0);
+	if (clst == 0)
+		return false;
+	*sectorp = cluster_to_sector (clst);
+	return true;
+}
+#else
+bool
+free_map_allocate_near (size_t cnt, disk_sector_t hint,
+		disk_sector_t *sectorp) {
+	struct free_run *r;
+
+	ASSERT (cnt > 0);
+
+	lock_acquire (&free_map_lock);
+	r = run_find (cnt, hint);
+	if (r != NULL)
+		*sectorp = run_take (r, cnt, hint);
+	lock_release (&free_map_lock);
+	return r != NULL;
+}
+#endif
+
+/* Allocates up to CNT consecutive sectors close to sector HINT and
+ * stores the first into *SECTORP.  If no free run is CNT sectors
+ * long, takes all of the longest one.
+ * Returns the number of sectors allocated, or 0 if the disk is
+ * full. */
+#ifdef EFILESYS
+size_t
+free_map_allocate_upto (size_t cnt UNUSED, disk_sector_t hint,
+		disk_sector_t *sectorp) {
+	return free_map_allocate_near (1, hint, sectorp) ? 1 : 0;
+}
+#else
+size_t
+free_map_allocate_upto (size_t cnt, disk_sector_t hint,
+		disk_sector_t *sectorp) {
+	struct free_run *r;
+	size_t got = 0;
+
+	ASSERT (cnt > 0);
+
+	lock_acquire (&free_map_lock);
+	r = run_find (cnt, hint);
+	if (r == NULL)
+		r = run_longest ();
+	if (r != NULL) {
+		got = r->length < cnt ? r->length : cnt;
+		*sectorp = run_take (r, got, hint);
+	}
+	lock_release (&free_map_lock);
+	return got;
+}
+#endif
+
+/* Allocates up to CNT free sectors starting exactly at SECTOR,
+ * which must be the first sector of a free run, as it is when the
+ * sector before it is in use.
+ * Returns the number of sectors allocated, possibly 0. */
+#ifdef EFILESYS
+size_t
+free_map_allocate_at (disk_sector_t sector UNUSED, size_t cnt UNUSED) {
+	return 0;
+}
+#else
+size_t
+free_map_allocate_at (disk_sector_t sector, size_t cnt) {
+	struct free_run *r;
+	size_t n = 0;
+
+	lock_acquire (&free_map_lock);
+	r = run_starting_at (sector);
+	if (r != NULL && cnt > 0) {
+		n = r->length < cnt ? r->length : cnt;
+		run_take (r, n, 0);
 	}
-	if (sector != BITMAP_ERROR)
-		*sectorp = sector;
-	return sector != BITMAP_ERROR;
+	lock_release (&free_map_lock);
+	return n;
 }
+#endif
 
 /* Makes CNT sectors starting at SECTOR available for use. */
 void
 free_map_release (disk_sector_t sector, size_t cnt) {
+#ifdef EFILESYS
+	ASSERT (cnt <= SECTORS_PER_CLUSTER);
+	fat_remove_chain (sector_to_cluster (sector), 0);
+#else
+	struct free_run *prev, *next, *r;
+
+	if (cnt == 0)
+		return;
+
+	lock_acquire (&free_map_lock);
 	ASSERT (bitmap_all (free_map, sector, cnt));
-	bitmap_set_multiple (free_map, sector, cnt, false);
-	bitmap_write (free_map, free_map_file);
+	set_sectors (sector, cnt, false);
+
+	/* Merge with the free runs on either side. */
+	prev = run_ending_at (sector);
+	next = run_starting_at (sector + cnt);
+	if (prev != NULL) {
+		run_remove (prev);
+		r = prev;
+		r->length += cnt;
+	} else {
+		r = malloc (sizeof *r);
+		if (r == NULL) {
+			/* The sectors are free in the bitmap, and are found
+			 * again when the summary is next built. */
+			lock_release (&free_map_lock);
+			return;
+		}
+		r->start = sector;
+		r->length = cnt;
+	}
+	if (next != NULL) {
+		run_remove (next);
+		r->length += next->length;
+		free (next);
+	}
+	run_insert (r);
+	lock_release (&free_map_lock);
+#endif
+}
+
+/* Writes the sectors of the free map file that changed since they
+ * were last written.  Called periodically by the buffer cache's
+ * write-behind thread, so that allocations only touch memory.
+ * Each run of changed sectors goes out as one write. */
+void
+free_map_flush (void) {
+#ifndef EFILESYS
+	size_t i, cnt;
+
+	lock_acquire (&free_map_lock);
+	for (i = 0; free_map_file != NULL; i += cnt) {
+		i = bitmap_scan_run (dirty_map, i, true, &cnt);
+		if (i == BITMAP_ERROR)
+			break;
+		bitmap_set_multiple (dirty_map, i, cnt, false);
+		if (!bitmap_write_part (free_map, free_map_file,
+					i * DISK_SECTOR_SIZE, cnt * DISK_SECTOR_SIZE))
+			bitmap_set_multiple (dirty_map, i, cnt, true);
+	}
+	lock_release (&free_map_lock);
+#endif
 }
 
-/* Opens the free map file and reads it from disk. */
+/* Opens the free map file and reads it from disk.  The free map
+ * file is read and written directly, so that its sectors move in
+ * multi-sector disk commands instead of through the buffer cache. */
 void
 free_map_open (void) {
 	free_map_file = file_open (inode_open (FREE_MAP_SECTOR));
 	if (free_map_file == NULL)
 		PANIC ("can't open free map");
+	file_set_direct (free_map_file);
 	if (!bitmap_read (free_map, free_map_file))
 		PANIC ("can't read free map");
+	bitmap_set_all (dirty_map, false);
+#ifndef EFILESYS
+	build_summary ();
+#endif
 }
 
 /* Writes the free map to disk and closes the free map file. */
 void
 free_map_close (void) {
+	free_map_flush ();
+	lock_acquire (&free_map_lock);
 	file_close (free_map_file);
+	free_map_file = NULL;
+	lock_release (&free_map_lock);
 }
 
 /* Creates a new free map file on disk and writes the free map to
@@ -72,6 +489,8 @@ free_map_create (void) {
 	free_map_file = file_open (inode_open (FREE_MAP_SECTOR));
 	if (free_map_file == NULL)
 		PANIC ("can't open free map");
+	file_set_direct (free_map_file);
 	if (!bitmap_write (free_map, free_map_file))
 		PANIC ("can't write free map");
+	bitmap_set_all (dirty_map, false);
 }
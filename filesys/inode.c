@@ -1,22 +1,59 @@
 #include "filesys/inode.h"
-#include <list.h>
+#include <hash.h>
+#include <iovec.h>
 #include <debug.h>
 #include <round.h>
+#include <stddef.h>
 #include <string.h>
+#include "filesys/fat.h"
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
+#include "filesys/page_cache.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
 
+/* A run of LENGTH consecutive data sectors starting at START, or
+ * a hole of LENGTH sectors that have no disk sectors yet and read
+ * back as zeros if START is HOLE. */
+struct extent {
+	disk_sector_t start;                /* First sector. */
+	uint32_t length;                    /* Number of sectors. */
+};
+
+/* START of a hole.  Sector 0 holds the free map inode, so it is
+ * never file data. */
+#define HOLE 0
+
+/* Number of extents held in the inode itself and in each extent
+ * block. */
+#define INODE_EXTENTS 61
+#define BLOCK_EXTENTS 63
+
 /* On-disk inode.
  * Must be exactly DISK_SECTOR_SIZE bytes long. */
 struct inode_disk {
-	disk_sector_t start;                /* First data sector. */
+	disk_sector_t start;                /* With EFILESYS, first cluster of
+	                                       the data chain. */
 	off_t length;                       /* File size in bytes. */
 	unsigned magic;                     /* Magic number. */
-	uint32_t unused[125];               /* Not used. */
+	uint32_t sector_cnt;                /* Number of data sectors, holes
+	                                       included. */
+	uint32_t extent_cnt;                /* Number of extents in use. */
+	disk_sector_t extent_block;         /* First extent block, 0 if none. */
+	struct extent extents[INODE_EXTENTS];   /* First extents, in file order. */
+};
+
+/* Extents past the first INODE_EXTENTS spill into a chain of
+ * these.
+ * Must be exactly DISK_SECTOR_SIZE bytes long. */
+struct extent_block {
+	disk_sector_t next;                 /* Next extent block, 0 if none. */
+	uint32_t unused;                    /* Not used. */
+	struct extent extents[BLOCK_EXTENTS];   /* Following extents. */
 };
 
 /* Returns the number of sectors to allocate for an inode SIZE
@@ -26,37 +63,592 @@ bytes_to_sectors (off_t size) {
 	return DIV_ROUND_UP (size, DISK_SECTOR_SIZE);
 }
 
+/* Packs extent index I and the index BASE of its first sector
+ * into one hint, so that lookups racing under a shared lock always
+ * see a matching pair. */
+#define HINT(I, BASE) ((uint64_t) (I) << 32 | (uint32_t) (BASE))
+#define HINT_IDX(H) ((size_t) ((H) >> 32))
+#define HINT_BASE(H) ((size_t) (uint32_t) (H))
+
 /* In-memory inode. */
 struct inode {
-	struct list_elem elem;              /* Element in inode list. */
+	struct hash_elem elem;              /* Element in open_inodes. */
 	disk_sector_t sector;               /* Sector number of disk location. */
 	int open_cnt;                       /* Number of openers. */
 	bool removed;                       /* True if deleted, false otherwise. */
 	int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
+	off_t read_end;                     /* End of the last read, for read-ahead. */
+	struct rwlock rw;                   /* Held shared to read or write
+	                                       data, exclusive to grow. */
+	struct extent *extents;             /* All extents, in file order. */
+	size_t extent_cap;                  /* Number of slots in EXTENTS. */
+	disk_sector_t *blocks;              /* Sectors of the extent blocks. */
+	size_t block_cnt;                   /* Number of extent blocks. */
+	uint64_t hint;                      /* Extent found by the last lookup
+	                                       and its first sector index. */
+	struct list fills;                  /* Writes' pending_fills. */
+	struct lock fill_lock;              /* Protects FILLS. */
+	struct condition fill_done;         /* Signaled when a fill ends. */
 	struct inode_disk data;             /* Inode content. */
 };
 
+/* Sectors of an inode's data that a write gave disk sectors without
+ * zeroing them, because the write covers them completely.  Until
+ * the write has put its data there, other threads that read them
+ * wait rather than see what those disk sectors held before. */
+struct pending_fill {
+	struct list_elem elem;              /* Element in the inode's FILLS. */
+	size_t idx;                         /* First sector. */
+	size_t cnt;                         /* Number of sectors, 0 if none. */
+	struct thread *writer;              /* Thread doing the write. */
+};
+
+/* Returns the disk sector that holds sector IDX of INODE's data,
+ * or HOLE if it lies in a hole, and stores in *RUN the number of
+ * sectors from there on that are contiguous on disk, or that are
+ * left in the hole. */
+static disk_sector_t
+data_run (struct inode *inode, size_t idx, size_t *run) {
+#ifdef EFILESYS
+	*run = SECTORS_PER_CLUSTER - idx % SECTORS_PER_CLUSTER;
+	return cluster_to_sector (fat_chain_nth (inode->data.start,
+				idx / SECTORS_PER_CLUSTER)) + idx % SECTORS_PER_CLUSTER;
+#else
+	uint64_t hint = inode->hint;
+	size_t i = 0, base = 0;
+
+	ASSERT (idx < inode->data.sector_cnt);
+
+	/* Sequential access finds its extent at or just past the last
+	 * one looked up. */
+	if (idx >= HINT_BASE (hint) && HINT_IDX (hint) < inode->data.extent_cnt) {
+		i = HINT_IDX (hint);
+		base = HINT_BASE (hint);
+	}
+	for (; i < inode->data.extent_cnt; base += inode->extents[i++].length)
+		if (idx < base + inode->extents[i].length) {
+			inode->hint = HINT (i, base);
+			*run = base + inode->extents[i].length - idx;
+			if (inode->extents[i].start == HOLE)
+				return HOLE;
+			return inode->extents[i].start + (idx - base);
+		}
+	NOT_REACHED ();
+#endif
+}
+
 /* Returns the disk sector that contains byte offset POS within
- * INODE.
+ * INODE, or HOLE if POS lies in a hole.
  * Returns -1 if INODE does not contain data for a byte at offset
  * POS. */
 static disk_sector_t
-byte_to_sector (const struct inode *inode, off_t pos) {
+byte_to_sector (struct inode *inode, off_t pos) {
+	size_t run;
+
 	ASSERT (inode != NULL);
 	if (pos < inode->data.length)
-		return inode->data.start + pos / DISK_SECTOR_SIZE;
+		return data_run (inode, pos / DISK_SECTOR_SIZE, &run);
 	else
 		return -1;
 }
 
-/* List of open inodes, so that opening a single inode twice
- * returns the same `struct inode'. */
-static struct list open_inodes;
+#ifndef EFILESYS
+/* Makes room for at least CNT extents in INODE's extent array.
+ * Returns true if successful. */
+static bool
+reserve_extents (struct inode *inode, size_t cnt) {
+	struct extent *extents;
+	size_t cap;
+
+	if (cnt <= inode->extent_cap)
+		return true;
+	cap = inode->extent_cap * 2 > cnt ? inode->extent_cap * 2 : cnt;
+	if (cap < INODE_EXTENTS)
+		cap = INODE_EXTENTS;
+	extents = realloc (inode->extents, cap * sizeof *extents);
+	if (extents == NULL)
+		return false;
+	inode->extents = extents;
+	inode->extent_cap = cap;
+	return true;
+}
+
+/* Reads INODE's extents, including those in extent blocks, into
+ * its extent array.
+ * Returns true if successful. */
+static bool
+load_extents (struct inode *inode) {
+	size_t cnt = inode->data.extent_cnt;
+	disk_sector_t block = inode->data.extent_block;
+	size_t i;
+
+	if (!reserve_extents (inode, cnt))
+		return false;
+	memcpy (inode->extents, inode->data.extents,
+			(cnt < INODE_EXTENTS ? cnt : INODE_EXTENTS) * sizeof (struct extent));
+
+	for (i = INODE_EXTENTS; i < cnt; i += BLOCK_EXTENTS) {
+		size_t n = cnt - i < BLOCK_EXTENTS ? cnt - i : BLOCK_EXTENTS;
+		disk_sector_t *blocks = realloc (inode->blocks,
+				(inode->block_cnt + 1) * sizeof *blocks);
+
+		if (blocks == NULL)
+			return false;
+		inode->blocks = blocks;
+		inode->blocks[inode->block_cnt++] = block;
+		page_cache_read (block, inode->extents + i,
+				offsetof (struct extent_block, extents), n * sizeof (struct extent));
+		page_cache_read (block, &block, offsetof (struct extent_block, next),
+				sizeof block);
+	}
+	return true;
+}
+
+/* Makes sure INODE has extent blocks to hold CNT extents,
+ * allocating a new one if needed.
+ * Returns true if successful. */
+static bool
+reserve_block (struct inode *inode, size_t cnt) {
+	disk_sector_t *blocks;
+
+	if (cnt <= INODE_EXTENTS + inode->block_cnt * BLOCK_EXTENTS)
+		return true;
+	blocks = realloc (inode->blocks, (inode->block_cnt + 1) * sizeof *blocks);
+	if (blocks == NULL)
+		return false;
+	inode->blocks = blocks;
+	if (!free_map_allocate_near (1, inode->sector, &blocks[inode->block_cnt]))
+		return false;
+	inode->block_cnt++;
+	return true;
+}
+
+/* Writes INODE's on-disk inode, and its extent blocks from the one
+ * holding extent FROM on. */
+static void
+store_extents (struct inode *inode, size_t from) {
+	size_t cnt = inode->data.extent_cnt;
+	size_t b;
+
+	memcpy (inode->data.extents, inode->extents,
+			(cnt < INODE_EXTENTS ? cnt : INODE_EXTENTS) * sizeof (struct extent));
+	inode->data.extent_block = inode->block_cnt > 0 ? inode->blocks[0] : 0;
+	page_cache_write (inode->sector, &inode->data, 0, DISK_SECTOR_SIZE);
+
+	/* The block before the first changed one may need a new NEXT
+	 * link, so rewrite it too. */
+	b = from <= INODE_EXTENTS ? 0 : (from - INODE_EXTENTS) / BLOCK_EXTENTS;
+	if (b > 0)
+		b--;
+	for (; b < inode->block_cnt; b++) {
+		size_t i = INODE_EXTENTS + b * BLOCK_EXTENTS;
+		size_t n = i >= cnt ? 0 : cnt - i < BLOCK_EXTENTS ? cnt - i : BLOCK_EXTENTS;
+		disk_sector_t next = b + 1 < inode->block_cnt ? inode->blocks[b + 1] : 0;
+
+		page_cache_write (inode->blocks[b], &next,
+				offsetof (struct extent_block, next), sizeof next);
+		if (n > 0)
+			page_cache_write (inode->blocks[b], inode->extents + i,
+					offsetof (struct extent_block, extents),
+					n * sizeof (struct extent));
+	}
+}
+#endif
+
+/* Sectors zeroed by one disk command, and the fewest worth
+ * zeroing on disk rather than in the buffer cache. */
+#define ZERO_CHUNK 8
+
+/* Fills CNT sectors starting at SECTOR with zeros.  A few sectors
+ * are zeroed in the buffer cache, which needs no disk access;
+ * longer runs are written ZERO_CHUNK sectors per disk command
+ * instead of pushing the whole cache out. */
+static void
+zero_sectors (disk_sector_t sector, size_t cnt) {
+	static char zeros[ZERO_CHUNK * DISK_SECTOR_SIZE];
+	size_t i;
+
+	if (cnt < ZERO_CHUNK) {
+		for (i = 0; i < cnt; i++)
+			page_cache_write (sector + i, zeros, 0, DISK_SECTOR_SIZE);
+		return;
+	}
+
+	/* Stale cached copies must neither be written back over the
+	 * zeros nor be read instead of them. */
+	page_cache_discard (sector, cnt);
+	for (i = 0; i < cnt; i += ZERO_CHUNK)
+		disk_write_multi (filesys_disk, sector + i,
+				cnt - i < ZERO_CHUNK ? cnt - i : ZERO_CHUNK, zeros);
+	page_cache_discard (sector, cnt);
+}
+
+/* Extends INODE's data to CNT sectors that read back as zeros.
+ * With EFILESYS the new clusters are allocated and zeroed right
+ * away, and growth that cannot fit in the free clusters is refused
+ * up front.  Otherwise the new sectors are added as a hole, and get
+ * disk sectors only when first written, by fill_holes().
+ * Returns true if successful; on failure, the sectors allocated so
+ * far, if any, stay with INODE. */
+static bool
+allocate_data (struct inode *inode, size_t cnt) {
+	struct inode_disk *d = &inode->data;
+#ifdef EFILESYS
+	cluster_t clst = d->sector_cnt > 0
+		? fat_chain_nth (d->start, d->sector_cnt / SECTORS_PER_CLUSTER - 1) : 0;
+	bool success = true;
+
+	if (cnt > d->sector_cnt && DIV_ROUND_UP (cnt - d->sector_cnt,
+				SECTORS_PER_CLUSTER) > fat_free_cnt ())
+		return false;
+	while (d->sector_cnt < cnt) {
+		clst = fat_create_chain (clst);
+		if (clst == 0) {
+			success = false;
+			break;
+		}
+		if (d->start == 0)
+			d->start = clst;
+		zero_sectors (cluster_to_sector (clst), SECTORS_PER_CLUSTER);
+		d->sector_cnt += SECTORS_PER_CLUSTER;
+	}
+	page_cache_write (inode->sector, d, 0, DISK_SECTOR_SIZE);
+	return success;
+#else
+	size_t from = d->extent_cnt > 0 ? d->extent_cnt - 1 : 0;
+	struct extent *last = d->extent_cnt > 0
+		? &inode->extents[d->extent_cnt - 1] : NULL;
+
+	if (cnt <= d->sector_cnt)
+		return true;
+	if (last != NULL && last->start == HOLE)
+		last->length += cnt - d->sector_cnt;
+	else if (reserve_extents (inode, d->extent_cnt + 1)
+			&& reserve_block (inode, d->extent_cnt + 1))
+		inode->extents[d->extent_cnt++] = (struct extent) {
+			.start = HOLE, .length = cnt - d->sector_cnt };
+	else
+		return false;
+	d->sector_cnt = cnt;
+	store_extents (inode, from);
+	return true;
+#endif
+}
+
+#ifndef EFILESYS
+/* Replaces sectors OFS through OFS + CNT of hole extent I of INODE
+ * with the CNT disk sectors starting at START, splitting the hole
+ * around them and merging them into the extent before if they
+ * continue it on disk.
+ * Returns true if successful. */
+static bool
+split_hole (struct inode *inode, size_t i, size_t ofs,
+		disk_sector_t start, size_t cnt) {
+	struct inode_disk *d = &inode->data;
+	struct extent *e = &inode->extents[i];
+	struct extent pieces[3];
+	size_t piece_cnt = 0;
+	size_t right = e->length - ofs - cnt;
+	bool merge = ofs == 0 && i > 0 && inode->extents[i - 1].start != HOLE
+		&& inode->extents[i - 1].start + inode->extents[i - 1].length == start;
+
+	ASSERT (e->start == HOLE && ofs + cnt <= e->length);
+
+	if (ofs > 0)
+		pieces[piece_cnt++] = (struct extent) { .start = HOLE, .length = ofs };
+	if (!merge)
+		pieces[piece_cnt++] = (struct extent) { .start = start, .length = cnt };
+	if (right > 0)
+		pieces[piece_cnt++] = (struct extent) { .start = HOLE, .length = right };
+
+	if (piece_cnt > 1
+			&& !(reserve_extents (inode, d->extent_cnt + piece_cnt - 1)
+				&& reserve_block (inode, d->extent_cnt + piece_cnt - 1)))
+		return false;
+
+	if (merge)
+		inode->extents[i - 1].length += cnt;
+	memmove (inode->extents + i + piece_cnt, inode->extents + i + 1,
+			(d->extent_cnt - i - 1) * sizeof *inode->extents);
+	memcpy (inode->extents + i, pieces, piece_cnt * sizeof *pieces);
+	d->extent_cnt = d->extent_cnt + piece_cnt - 1;
+	return true;
+}
+
+/* Zeros the CNT new disk sectors starting at START, which hold
+ * data sectors IDX onward, except those holding data sectors
+ * KEEP_FROM through KEEP_TO, which are about to be overwritten. */
+static void
+zero_new_sectors (disk_sector_t start, size_t idx, size_t cnt,
+		size_t keep_from, size_t keep_to) {
+	size_t end = idx + cnt;
+	size_t lo = keep_from > idx ? keep_from : idx;
+	size_t hi = keep_to < end ? keep_to : end;
+
+	if (lo >= hi) {
+		zero_sectors (start, cnt);
+		return;
+	}
+	if (lo > idx)
+		zero_sectors (start, lo - idx);
+	if (end > hi)
+		zero_sectors (start + (hi - idx), end - hi);
+}
+
+/* Gives disk sectors to the parts of sectors IDX through IDX + CNT
+ * of INODE's data that lie in holes, and zeros them, except for
+ * data sectors KEEP_FROM through KEEP_TO.  Each part is placed where
+ * it would continue the data before it on disk if possible.
+ * The caller must hold INODE's lock exclusively.
+ * Returns the number of sectors from IDX on that now have disk
+ * sectors: CNT if successful, fewer if the disk or memory ran out,
+ * in which case the sectors allocated so far stay with INODE. */
+static size_t
+fill_holes (struct inode *inode, size_t idx, size_t cnt,
+		size_t keep_from, size_t keep_to) {
+	struct inode_disk *d = &inode->data;
+	size_t first = idx, end = idx + cnt;
+	size_t from = d->extent_cnt;
+	size_t i = 0, base = 0;
+
+	ASSERT (end <= d->sector_cnt);
+
+	while (idx < end) {
+		struct extent *e, *prev;
+		size_t ofs, n, got;
+		disk_sector_t hint, start;
+
+		/* Find the extent holding IDX. */
+		while (idx >= base + inode->extents[i].length)
+			base += inode->extents[i++].length;
+		e = &inode->extents[i];
+		if (e->start != HOLE) {
+			idx = base + e->length;
+			continue;
+		}
+
+		ofs = idx - base;
+		n = (base + e->length < end ? base + e->length : end) - idx;
+		prev = i > 0 && inode->extents[i - 1].start != HOLE
+			? &inode->extents[i - 1] : NULL;
+		hint = (prev != NULL ? prev->start + prev->length : inode->sector + 1)
+			+ ofs;
+		start = hint;
+		got = free_map_allocate_at (hint, n);
+		if (got == 0)
+			got = free_map_allocate_upto (n, hint, &start);
+		if (got == 0 || !split_hole (inode, i, ofs, start, got)) {
+			if (got > 0)
+				free_map_release (start, got);
+			break;
+		}
+		zero_new_sectors (start, idx, got, keep_from, keep_to);
+		if (from > (i > 0 ? i - 1 : 0))
+			from = i > 0 ? i - 1 : 0;
+		idx += got;
+
+		/* The extents from I on may have moved. */
+		i = 0;
+		base = 0;
+	}
+
+	inode->hint = HINT (0, 0);
+	if (from < d->extent_cnt)
+		store_extents (inode, from);
+	return (idx < end ? idx : end) - first;
+}
+
+/* Returns true if any of sectors IDX through IDX + CNT of INODE's
+ * data lies in a hole. */
+static bool
+has_hole (struct inode *inode, size_t idx, size_t cnt) {
+	while (cnt > 0) {
+		size_t run;
+
+		if (data_run (inode, idx, &run) == HOLE)
+			return true;
+		if (run >= cnt)
+			break;
+		idx += run;
+		cnt -= run;
+	}
+	return false;
+}
+#endif
+
+/* Makes sure that bytes OFFSET through OFFSET + SIZE of INODE,
+ * which must lie within its length, have disk sectors.  If FILL is
+ * nonnull, the caller is about to write all of those bytes, so the
+ * sectors they cover completely are not zeroed but recorded in FILL,
+ * which the caller must pass to fill_finish() once it has written
+ * them.  Otherwise every new sector is zeroed.
+ * Returns the number of bytes from OFFSET on that have disk sectors:
+ * SIZE if successful, fewer if the disk or memory ran out. */
+static off_t
+fill_range (struct inode *inode UNUSED, off_t offset UNUSED, off_t size,
+		struct pending_fill *fill) {
+	if (fill != NULL)
+		fill->cnt = 0;
+#ifdef EFILESYS
+	return size;
+#else
+	size_t idx = offset / DISK_SECTOR_SIZE;
+	size_t cnt = DIV_ROUND_UP (offset + size, DISK_SECTOR_SIZE) - idx;
+	size_t keep_from = DIV_ROUND_UP (offset, DISK_SECTOR_SIZE);
+	size_t keep_to = (offset + size) / DISK_SECTOR_SIZE;
+	size_t filled;
+	bool hole;
+
+	rwlock_acquire_read (&inode->rw);
+	hole = has_hole (inode, idx, cnt);
+	rwlock_release_read (&inode->rw);
+
+	/* Holes never come back once filled, so one that is gone by
+	 * now was filled by someone else. */
+	if (!hole)
+		return size;
+
+	if (fill == NULL)
+		keep_to = keep_from;
+	rwlock_acquire_write (&inode->rw);
+	filled = fill_holes (inode, idx, cnt, keep_from, keep_to);
+
+	/* Register the unzeroed sectors before anyone else can get
+	 * at them. */
+	if (idx + filled < keep_to)
+		keep_to = idx + filled;
+	if (keep_from < keep_to) {
+		fill->idx = keep_from;
+		fill->cnt = keep_to - keep_from;
+		fill->writer = thread_current ();
+		lock_acquire (&inode->fill_lock);
+		list_push_back (&inode->fills, &fill->elem);
+		lock_release (&inode->fill_lock);
+	}
+	rwlock_release_write (&inode->rw);
+
+	if (filled == cnt)
+		return size;
+	return (off_t) ((idx + filled) * DISK_SECTOR_SIZE) > offset
+		? (off_t) ((idx + filled) * DISK_SECTOR_SIZE) - offset : 0;
+#endif
+}
+
+/* Ends FILL, set up by fill_range(), whose sectors have now been
+ * written, and wakes the readers waiting for it. */
+static void
+fill_finish (struct inode *inode, struct pending_fill *fill) {
+	if (fill->cnt == 0)
+		return;
+	lock_acquire (&inode->fill_lock);
+	list_remove (&fill->elem);
+	cond_broadcast (&inode->fill_done, &inode->fill_lock);
+	lock_release (&inode->fill_lock);
+}
+
+/* Returns true if a pending fill of another thread overlaps sectors
+ * IDX through END of INODE.  The caller must hold INODE's
+ * FILL_LOCK. */
+static bool
+fill_overlaps (struct inode *inode, size_t idx, size_t end) {
+	struct list_elem *e;
+
+	for (e = list_begin (&inode->fills); e != list_end (&inode->fills);
+			e = list_next (e)) {
+		struct pending_fill *f = list_entry (e, struct pending_fill, elem);
+		if (f->writer != thread_current ()
+				&& f->idx < end && idx < f->idx + f->cnt)
+			return true;
+	}
+	return false;
+}
+
+/* Waits until no other thread is about to write sectors of bytes
+ * OFFSET through OFFSET + SIZE of INODE that it gave disk sectors
+ * without zeroing them.  The caller must hold INODE's lock shared,
+ * so that no new fill can start meanwhile. */
+static void
+fill_wait (struct inode *inode, off_t offset, off_t size) {
+	size_t idx = offset / DISK_SECTOR_SIZE;
+	size_t end = DIV_ROUND_UP (offset + size, DISK_SECTOR_SIZE);
+
+	if (size <= 0 || list_empty (&inode->fills))
+		return;
+	lock_acquire (&inode->fill_lock);
+	while (fill_overlaps (inode, idx, end))
+		cond_wait (&inode->fill_done, &inode->fill_lock);
+	lock_release (&inode->fill_lock);
+}
+
+/* Makes sure that bytes OFFSET through OFFSET + SIZE of INODE,
+ * which must lie within its length, have disk sectors, zeroed where
+ * they were holes, so that later writes there never have to fill
+ * holes.
+ * Returns true if successful. */
+bool
+inode_fill (struct inode *inode, off_t offset, off_t size) {
+	return fill_range (inode, offset, size, NULL) == size;
+}
+
+/* Releases all data sectors of INODE, and its extent blocks. */
+static void
+release_data (struct inode *inode) {
+#ifdef EFILESYS
+	if (inode->data.start != 0)
+		fat_remove_chain (inode->data.start, 0);
+#else
+	size_t i;
+
+	for (i = 0; i < inode->data.extent_cnt; i++)
+		if (inode->extents[i].start != HOLE)
+			free_map_release (inode->extents[i].start, inode->extents[i].length);
+	for (i = 0; i < inode->block_cnt; i++)
+		free_map_release (inode->blocks[i], 1);
+#endif
+}
+
+/* Extends INODE to LENGTH bytes, which read back as zeros.
+ * Returns true if successful, false if disk space ran out. */
+static bool
+inode_grow (struct inode *inode, off_t length) {
+	bool success = true;
+
+	rwlock_acquire_write (&inode->rw);
+	if (length > inode->data.length) {
+		success = allocate_data (inode, bytes_to_sectors (length));
+		if (success) {
+			inode->data.length = length;
+			page_cache_write (inode->sector, &inode->data, 0, DISK_SECTOR_SIZE);
+		}
+	}
+	rwlock_release_write (&inode->rw);
+	return success;
+}
+
+/* Open inodes by sector, so that opening a single inode twice
+ * returns the same `struct inode'.  OPEN_INODES_LOCK protects the
+ * table and the open_cnt of every inode in it. */
+static struct hash open_inodes;
+static struct lock open_inodes_lock;
+
+static uint64_t
+inode_hash (const struct hash_elem *e, void *aux UNUSED) {
+	return hash_int (hash_entry (e, struct inode, elem)->sector);
+}
+
+static bool
+inode_less (const struct hash_elem *a, const struct hash_elem *b,
+		void *aux UNUSED) {
+	return hash_entry (a, struct inode, elem)->sector
+		< hash_entry (b, struct inode, elem)->sector;
+}
 
 /* Initializes the inode module. */
 void
 inode_init (void) {
-	list_init (&open_inodes);
+	if (!hash_init (&open_inodes, inode_hash, inode_less, NULL))
+		PANIC ("inode table creation failed");
+	lock_init (&open_inodes_lock);
 }
 
 /* Initializes an inode with LENGTH bytes of data and
@@ -67,6 +659,7 @@ inode_init (void) {
 bool
 inode_create (disk_sector_t sector, off_t length) {
 	struct inode_disk *disk_inode = NULL;
+	struct inode *inode;
 	bool success = false;
 
 	ASSERT (length >= 0);
@@ -74,24 +667,22 @@ inode_create (disk_sector_t sector, off_t length) {
 	/* If this assertion fails, the inode structure is not exactly
 	 * one sector in size, and you should fix that. */
 	ASSERT (sizeof *disk_inode == DISK_SECTOR_SIZE);
+	ASSERT (sizeof (struct extent_block) == DISK_SECTOR_SIZE);
 
+	/* Write an empty inode, then grow it to LENGTH. */
 	disk_inode = calloc (1, sizeof *disk_inode);
-	if (disk_inode != NULL) {
-		size_t sectors = bytes_to_sectors (length);
-		disk_inode->length = length;
-		disk_inode->magic = INODE_MAGIC;
-		if (free_map_allocate (sectors, &disk_inode->start)) {
-			disk_write (filesys_disk, sector, disk_inode);
-			if (sectors > 0) {
-				static char zeros[DISK_SECTOR_SIZE];
-				size_t i;
-
-				for (i = 0; i < sectors; i++) 
-					disk_write (filesys_disk, disk_inode->start + i, zeros); 
-			}
-			success = true; 
-		} 
-		free (disk_inode);
+	if (disk_inode == NULL)
+		return false;
+	disk_inode->magic = INODE_MAGIC;
+	page_cache_write (sector, disk_inode, 0, DISK_SECTOR_SIZE);
+	free (disk_inode);
+
+	inode = inode_open (sector);
+	if (inode != NULL) {
+		success = inode_grow (inode, length);
+		if (!success)
+			release_data (inode);
+		inode_close (inode);
 	}
 	return success;
 }
@@ -101,39 +692,66 @@ inode_create (disk_sector_t sector, off_t length) {
  * Returns a null pointer if memory allocation fails. */
 struct inode *
 inode_open (disk_sector_t sector) {
-	struct list_elem *e;
+	struct inode key;
+	struct hash_elem *e;
 	struct inode *inode;
 
 	/* Check whether this inode is already open. */
-	for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
-			e = list_next (e)) {
-		inode = list_entry (e, struct inode, elem);
-		if (inode->sector == sector) {
-			inode_reopen (inode);
-			return inode; 
-		}
+	lock_acquire (&open_inodes_lock);
+	key.sector = sector;
+	e = hash_find (&open_inodes, &key.elem);
+	if (e != NULL) {
+		inode = hash_entry (e, struct inode, elem);
+		inode->open_cnt++;
+		lock_release (&open_inodes_lock);
+		return inode;
 	}
 
 	/* Allocate memory. */
 	inode = malloc (sizeof *inode);
-	if (inode == NULL)
+	if (inode == NULL) {
+		lock_release (&open_inodes_lock);
 		return NULL;
+	}
 
 	/* Initialize. */
-	list_push_front (&open_inodes, &inode->elem);
 	inode->sector = sector;
 	inode->open_cnt = 1;
 	inode->deny_write_cnt = 0;
 	inode->removed = false;
-	disk_read (filesys_disk, inode->sector, &inode->data);
+	inode->read_end = 0;
+	rwlock_init (&inode->rw);
+	inode->extents = NULL;
+	inode->extent_cap = 0;
+	inode->blocks = NULL;
+	inode->block_cnt = 0;
+	inode->hint = HINT (0, 0);
+	list_init (&inode->fills);
+	lock_init (&inode->fill_lock);
+	cond_init (&inode->fill_done);
+	page_cache_read (inode->sector, &inode->data, 0, DISK_SECTOR_SIZE);
+#ifndef EFILESYS
+	if (!load_extents (inode)) {
+		lock_release (&open_inodes_lock);
+		free (inode->extents);
+		free (inode->blocks);
+		free (inode);
+		return NULL;
+	}
+#endif
+	hash_insert (&open_inodes, &inode->elem);
+	lock_release (&open_inodes_lock);
 	return inode;
 }
 
 /* Reopens and returns INODE. */
 struct inode *
 inode_reopen (struct inode *inode) {
-	if (inode != NULL)
+	if (inode != NULL) {
+		lock_acquire (&open_inodes_lock);
 		inode->open_cnt++;
+		lock_release (&open_inodes_lock);
+	}
 	return inode;
 }
 
@@ -153,19 +771,23 @@ inode_close (struct inode *inode) {
 		return;
 
 	/* Release resources if this was the last opener. */
-	if (--inode->open_cnt == 0) {
-		/* Remove from inode list and release lock. */
-		list_remove (&inode->elem);
-
-		/* Deallocate blocks if removed. */
-		if (inode->removed) {
-			free_map_release (inode->sector, 1);
-			free_map_release (inode->data.start,
-					bytes_to_sectors (inode->data.length)); 
-		}
+	lock_acquire (&open_inodes_lock);
+	if (--inode->open_cnt > 0) {
+		lock_release (&open_inodes_lock);
+		return;
+	}
+	hash_delete (&open_inodes, &inode->elem);
+	lock_release (&open_inodes_lock);
 
-		free (inode); 
+	/* Deallocate blocks if removed. */
+	if (inode->removed) {
+		free_map_release (inode->sector, 1);
+		release_data (inode);
 	}
+
+	free (inode->extents);
+	free (inode->blocks);
+	free (inode); 
 }
 
 /* Marks INODE to be deleted when it is closed by the last caller who
@@ -176,14 +798,32 @@ inode_remove (struct inode *inode) {
 	inode->removed = true;
 }
 
-/* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
- * Returns the number of bytes actually read, which may be less
- * than SIZE if an error occurs or end of file is reached. */
-off_t
-inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) {
-	uint8_t *buffer = buffer_;
+/* Returns the number of whole sectors, at most DISK_MULTI_MAX, that
+ * a direct transfer of SIZE bytes at OFFSET of INODE can move from
+ * SECTOR on in one go, or 0 if none.  SECTOR must be the one
+ * holding OFFSET. */
+static size_t
+direct_run (struct inode *inode, disk_sector_t sector, off_t offset,
+		off_t size) {
+	off_t left = inode_length (inode) - offset;
+	size_t run, cnt;
+
+	if (sector == HOLE || offset % DISK_SECTOR_SIZE != 0
+			|| size < DISK_SECTOR_SIZE || left < DISK_SECTOR_SIZE)
+		return 0;
+	data_run (inode, offset / DISK_SECTOR_SIZE, &run);
+	cnt = (size < left ? size : left) / DISK_SECTOR_SIZE;
+	if (cnt > run)
+		cnt = run;
+	return cnt < DISK_MULTI_MAX ? cnt : DISK_MULTI_MAX;
+}
+
+/* Reads SIZE bytes from INODE into BUFFER, starting at OFFSET,
+ * with INODE's rw lock held.  Returns the number of bytes read. */
+static off_t
+read_locked (struct inode *inode, uint8_t *buffer, off_t size, off_t offset,
+		bool direct) {
 	off_t bytes_read = 0;
-	uint8_t *bounce = NULL;
 
 	while (size > 0) {
 		/* Disk sector to read, starting byte offset within sector. */
@@ -197,48 +837,104 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) {
 
 		/* Number of bytes to actually copy out of this sector. */
 		int chunk_size = size < min_left ? size : min_left;
+		size_t run = direct ? direct_run (inode, sector_idx, offset, size) : 0;
 		if (chunk_size <= 0)
 			break;
 
-		if (sector_ofs == 0 && chunk_size == DISK_SECTOR_SIZE) {
-			/* Read full sector directly into caller's buffer. */
-			disk_read (filesys_disk, sector_idx, buffer + bytes_read); 
-		} else {
-			/* Read sector into bounce buffer, then partially copy
-			 * into caller's buffer. */
-			if (bounce == NULL) {
-				bounce = malloc (DISK_SECTOR_SIZE);
-				if (bounce == NULL)
-					break;
-			}
-			disk_read (filesys_disk, sector_idx, bounce);
-			memcpy (buffer + bytes_read, bounce + sector_ofs, chunk_size);
-		}
+		if (run > 0) {
+			page_cache_read_direct (sector_idx, buffer + bytes_read, run);
+			chunk_size = run * DISK_SECTOR_SIZE;
+		} else if (sector_idx == HOLE)
+			memset (buffer + bytes_read, 0, chunk_size);
+		else
+			page_cache_read (sector_idx, buffer + bytes_read, sector_ofs,
+					chunk_size);
 
 		/* Advance. */
 		size -= chunk_size;
 		offset += chunk_size;
 		bytes_read += chunk_size;
 	}
-	free (bounce);
+	return bytes_read;
+}
+
+/* Reads INODE from OFFSET on into the CNT buffers of IOV in turn,
+ * taking INODE's rw lock once for all of them.  Does the work of
+ * inode_read_at(), inode_read_direct() and inode_readv(). */
+static off_t
+read_vec (struct inode *inode, const struct iovec *iov, size_t cnt,
+		off_t offset, bool direct) {
+	off_t bytes_read = 0;
+	off_t size = 0;
+	bool sequential = !direct && offset == inode->read_end;
+	size_t i;
+
+	for (i = 0; i < cnt; i++)
+		size += iov[i].iov_len;
+	rwlock_acquire_read (&inode->rw);
+	fill_wait (inode, offset, size);
+	for (i = 0; i < cnt; i++) {
+		off_t size = iov[i].iov_len;
+		off_t n = read_locked (inode, iov[i].iov_base, size,
+				offset + bytes_read, direct);
+		bytes_read += n;
+		if (n < size)
+			break;
+	}
+	offset += bytes_read;
+
+	/* On a sequential read, start fetching the sector that the next
+	 * read will want. */
+	inode->read_end = offset;
+	if (sequential && bytes_read > 0) {
+		off_t next = ROUND_UP (offset, DISK_SECTOR_SIZE);
+		if (next < inode_length (inode)) {
+			disk_sector_t sector = byte_to_sector (inode, next);
+			if (sector != HOLE)
+				page_cache_prefetch (sector);
+		}
+	}
+	rwlock_release_read (&inode->rw);
 
 	return bytes_read;
 }
 
-/* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
- * Returns the number of bytes actually written, which may be
- * less than SIZE if end of file is reached or an error occurs.
- * (Normally a write at end of file would extend the inode, but
- * growth is not yet implemented.) */
+/* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
+ * Returns the number of bytes actually read, which may be less
+ * than SIZE if an error occurs or end of file is reached. */
+off_t
+inode_read_at (struct inode *inode, void *buffer, off_t size, off_t offset) {
+	struct iovec iov = { buffer, size };
+	return read_vec (inode, &iov, 1, offset, false);
+}
+
+/* Like inode_read_at(), but whole sectors that are not cached are
+ * read from disk straight into BUFFER, without being cached.
+ * Accessing BUFFER must not fault, so a user buffer must be
+ * pinned. */
 off_t
-inode_write_at (struct inode *inode, const void *buffer_, off_t size,
+inode_read_direct (struct inode *inode, void *buffer, off_t size,
 		off_t offset) {
-	const uint8_t *buffer = buffer_;
-	off_t bytes_written = 0;
-	uint8_t *bounce = NULL;
+	struct iovec iov = { buffer, size };
+	return read_vec (inode, &iov, 1, offset, true);
+}
 
-	if (inode->deny_write_cnt)
-		return 0;
+/* Reads INODE, starting at OFFSET, into the CNT buffers of IOV in
+ * order.  Returns the total number of bytes read, which falls
+ * short of the buffers' total only at end of file. */
+off_t
+inode_readv (struct inode *inode, const struct iovec *iov, size_t cnt,
+		off_t offset) {
+	return read_vec (inode, iov, cnt, offset, false);
+}
+
+/* Writes SIZE bytes from BUFFER into INODE at OFFSET, with INODE's
+ * rw lock held and its sectors already in place.  Returns the
+ * number of bytes written. */
+static off_t
+write_locked (struct inode *inode, const uint8_t *buffer, off_t size,
+		off_t offset, bool direct) {
+	off_t bytes_written = 0;
 
 	while (size > 0) {
 		/* Sector to write, starting byte offset within sector. */
@@ -252,48 +948,115 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 
 		/* Number of bytes to actually write into this sector. */
 		int chunk_size = size < min_left ? size : min_left;
+		size_t run = direct ? direct_run (inode, sector_idx, offset, size) : 0;
 		if (chunk_size <= 0)
 			break;
 
-		if (sector_ofs == 0 && chunk_size == DISK_SECTOR_SIZE) {
-			/* Write full sector directly to disk. */
-			disk_write (filesys_disk, sector_idx, buffer + bytes_written); 
-		} else {
-			/* We need a bounce buffer. */
-			if (bounce == NULL) {
-				bounce = malloc (DISK_SECTOR_SIZE);
-				if (bounce == NULL)
-					break;
-			}
-
-			/* If the sector contains data before or after the chunk
-			   we're writing, then we need to read in the sector
-			   first.  Otherwise we start with a sector of all zeros. */
-			if (sector_ofs > 0 || chunk_size < sector_left) 
-				disk_read (filesys_disk, sector_idx, bounce);
-			else
-				memset (bounce, 0, DISK_SECTOR_SIZE);
-			memcpy (bounce + sector_ofs, buffer + bytes_written, chunk_size);
-			disk_write (filesys_disk, sector_idx, bounce); 
-		}
+		/* The cache reads the sector in first unless the chunk
+		   covers all of it. */
+		if (run > 0) {
+			page_cache_write_direct (sector_idx, buffer + bytes_written, run);
+			chunk_size = run * DISK_SECTOR_SIZE;
+		} else
+			page_cache_write (sector_idx, buffer + bytes_written, sector_ofs,
+					chunk_size);
 
 		/* Advance. */
 		size -= chunk_size;
 		offset += chunk_size;
 		bytes_written += chunk_size;
 	}
-	free (bounce);
+	return bytes_written;
+}
+
+/* Writes the CNT buffers of IOV in turn into INODE from OFFSET on,
+ * growing INODE and filling holes once for the whole range and
+ * taking its rw lock once.  Does the work of inode_write_at(),
+ * inode_write_direct() and inode_writev(). */
+static off_t
+write_vec (struct inode *inode, const struct iovec *iov, size_t cnt,
+		off_t offset, bool direct) {
+	struct pending_fill fill;
+	off_t bytes_written = 0;
+	off_t size = 0;
+	size_t i;
+
+	if (inode->deny_write_cnt)
+		return 0;
+	for (i = 0; i < cnt; i++)
+		size += iov[i].iov_len;
+	if (size > 0 && offset + size > inode_length (inode)
+			&& !inode_grow (inode, offset + size))
+		return 0;
+
+	/* If the disk fills up, write as much as got disk sectors. */
+	size = fill_range (inode, offset, size, &fill);
+
+	/* Check again under the lock, which inode_deny_write() takes
+	 * exclusively.  A write that left sectors unzeroed must still
+	 * fill them. */
+	rwlock_acquire_read (&inode->rw);
+	if (inode->deny_write_cnt && fill.cnt == 0)
+		cnt = 0;
+	for (i = 0; i < cnt && bytes_written < size; i++) {
+		off_t len = iov[i].iov_len;
+		off_t n;
+
+		if (len > size - bytes_written)
+			len = size - bytes_written;
+		n = write_locked (inode, iov[i].iov_base, len,
+				offset + bytes_written, direct);
+		bytes_written += n;
+		if (n < len)
+			break;
+	}
+	rwlock_release_read (&inode->rw);
+	fill_finish (inode, &fill);
 
 	return bytes_written;
 }
 
+/* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET,
+ * extending INODE first if the write ends past end of file; any
+ * gap before OFFSET is left as a hole that reads back as zeros.
+ * Returns the number of bytes actually written, which may be
+ * less than SIZE if the disk is full or an error occurs.  A write
+ * into a hole that fails for lack of disk space may still have
+ * extended INODE. */
+off_t
+inode_write_at (struct inode *inode, const void *buffer, off_t size,
+		off_t offset) {
+	struct iovec iov = { (void *) buffer, size };
+	return write_vec (inode, &iov, 1, offset, false);
+}
+
+/* Like inode_write_at(), but whole sectors that are not cached are
+ * written from BUFFER straight to disk.  Accessing BUFFER must not
+ * fault, so a user buffer must be pinned. */
+off_t
+inode_write_direct (struct inode *inode, const void *buffer, off_t size,
+		off_t offset) {
+	struct iovec iov = { (void *) buffer, size };
+	return write_vec (inode, &iov, 1, offset, true);
+}
+
+/* Writes the CNT buffers of IOV in order into INODE, starting at
+ * OFFSET.  Otherwise like inode_write_at(). */
+off_t
+inode_writev (struct inode *inode, const struct iovec *iov, size_t cnt,
+		off_t offset) {
+	return write_vec (inode, iov, cnt, offset, false);
+}
+
 /* Disables writes to INODE.
    May be called at most once per inode opener. */
 	void
 inode_deny_write (struct inode *inode) 
 {
+	rwlock_acquire_write (&inode->rw);
 	inode->deny_write_cnt++;
 	ASSERT (inode->deny_write_cnt <= inode->open_cnt);
+	rwlock_release_write (&inode->rw);
 }
 
 /* Re-enables writes to INODE.
@@ -303,7 +1066,9 @@ void
 inode_allow_write (struct inode *inode) {
 	ASSERT (inode->deny_write_cnt > 0);
 	ASSERT (inode->deny_write_cnt <= inode->open_cnt);
+	rwlock_acquire_write (&inode->rw);
 	inode->deny_write_cnt--;
+	rwlock_release_write (&inode->rw);
 }
 
 /* Returns the length, in bytes, of INODE's data. */
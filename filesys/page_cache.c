@@ -1,9 +1,20 @@
 /* page_cache.c: Implementation of Page Cache (Buffer Cache). */
 
+#include "filesys/page_cache.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "filesys/filesys.h"
+#include "filesys/free-map.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
 #include "vm/vm.h"
 static bool page_cache_readahead (struct page *page, void *kva);
 static bool page_cache_writeback (struct page *page);
 static void page_cache_destroy (struct page *page);
+static void page_cache_kworkerd (void *aux);
+static void page_cache_flusherd (void *aux);
 
 /* DO NOT MODIFY this struct */
 static const struct page_operations page_cache_op = {
@@ -15,36 +26,484 @@ static const struct page_operations page_cache_op = {
 
 tid_t page_cache_workerd;
 
+/* Interval between two passes of the write-behind thread. */
+#define WRITE_BEHIND_MS 1000
+
+/* Maximum number of sectors waiting for read-ahead. */
+#define RA_QUEUE_SIZE 16
+
+/* Marks an unused cache entry. */
+#define SECTOR_NONE ((disk_sector_t) -1)
+
+/* One cached disk sector.
+ * An entry whose IO flag is set, or which is not yet VALID, must not
+ * be touched until its owner broadcasts CACHE_CHANGED.  USERS counts
+ * threads copying to or from DATA with CACHE_LOCK released; such an
+ * entry is never chosen for eviction. */
+struct cache_entry {
+	disk_sector_t sector;               /* Cached sector or SECTOR_NONE. */
+	bool valid;                         /* DATA holds the sector contents. */
+	bool dirty;                         /* DATA is newer than the disk. */
+	bool accessed;                      /* Referenced since last clock pass. */
+	bool io;                            /* Disk transfer in progress. */
+	int users;                          /* Threads copying DATA. */
+	struct disk_request req;            /* Write-back by page_cache_flush(). */
+	uint8_t data[DISK_SECTOR_SIZE];
+};
+
+static struct cache_entry cache[PAGE_CACHE_SIZE];
+static struct lock cache_lock;
+static struct condition cache_changed;
+static size_t clock_hand;
+
+/* Sectors queued for asynchronous read-ahead, consumed by
+ * page_cache_kworkerd. */
+static disk_sector_t ra_queue[RA_QUEUE_SIZE];
+static size_t ra_head, ra_tail;
+static struct semaphore ra_sema;
+
+/* Statistics. */
+static long long hit_cnt, miss_cnt, readahead_cnt, writeback_cnt, direct_cnt;
+
 /* The initializer of file vm */
 void
 pagecache_init (void) {
-	/* TODO: Create a worker daemon for page cache with page_cache_kworkerd */
+	/* The sector cache and its worker threads are brought up by
+	 * page_cache_init() from filesys_init(). */
+}
+
+/* Initializes the buffer cache and starts its read-ahead and
+ * write-behind threads.  Must be called before any access to the
+ * file system disk. */
+void
+page_cache_init (void) {
+	size_t i;
+
+	lock_init (&cache_lock);
+	cond_init (&cache_changed);
+	sema_init (&ra_sema, 0);
+	for (i = 0; i < PAGE_CACHE_SIZE; i++)
+		cache[i].sector = SECTOR_NONE;
+
+	page_cache_workerd = thread_create ("cache_ra", PRI_DEFAULT,
+			page_cache_kworkerd, NULL);
+	thread_create ("cache_wb", PRI_DEFAULT, page_cache_flusherd, NULL);
+}
+
+/* Returns the entry caching SECTOR, or a null pointer. */
+static struct cache_entry *
+cache_lookup (disk_sector_t sector) {
+	size_t i;
+
+	for (i = 0; i < PAGE_CACHE_SIZE; i++)
+		if (cache[i].sector == sector)
+			return &cache[i];
+	return NULL;
+}
+
+/* Chooses an entry to reuse with the clock algorithm, skipping
+ * entries that are in use.  Returns a null pointer if every entry
+ * is busy. */
+static struct cache_entry *
+cache_victim (void) {
+	size_t i;
+
+	for (i = 0; i < 2 * PAGE_CACHE_SIZE; i++) {
+		struct cache_entry *e = &cache[clock_hand];
+		clock_hand = (clock_hand + 1) % PAGE_CACHE_SIZE;
+
+		if (e->io || e->users > 0 || (e->sector != SECTOR_NONE && !e->valid))
+			continue;
+		if (e->accessed) {
+			e->accessed = false;
+			continue;
+		}
+		return e;
+	}
+	return NULL;
+}
+
+/* Writes dirty entry E back to disk.  CACHE_LOCK is released during
+ * the transfer; a write that lands meanwhile marks E dirty again. */
+static void
+cache_writeback (struct cache_entry *e) {
+	ASSERT (lock_held_by_current_thread (&cache_lock));
+	ASSERT (e->valid && e->dirty && !e->io);
+
+	e->io = true;
+	e->dirty = false;
+	writeback_cnt++;
+	lock_release (&cache_lock);
+	disk_write (filesys_disk, e->sector, e->data);
+	lock_acquire (&cache_lock);
+	e->io = false;
+	cond_broadcast (&cache_changed, &cache_lock);
+}
+
+/* Returns the entry for SECTOR with its USERS count raised.
+ * If the sector is not cached, an entry is evicted for it and,
+ * if FILL, the sector is read in; otherwise the entry is left
+ * invalid and the caller must overwrite all of DATA and then set
+ * VALID.  Must be called with CACHE_LOCK held. */
+static struct cache_entry *
+cache_get (disk_sector_t sector, bool fill) {
+	struct cache_entry *e;
+
+	ASSERT (lock_held_by_current_thread (&cache_lock));
+
+	for (;;) {
+		e = cache_lookup (sector);
+		if (e != NULL) {
+			if (e->io || !e->valid) {
+				cond_wait (&cache_changed, &cache_lock);
+				continue;
+			}
+			hit_cnt++;
+			e->users++;
+			e->accessed = true;
+			return e;
+		}
+
+		e = cache_victim ();
+		if (e == NULL) {
+			cond_wait (&cache_changed, &cache_lock);
+			continue;
+		}
+		if (e->valid && e->dirty) {
+			/* SECTOR may have been brought in by someone else while
+			 * the lock was dropped, so look it up again. */
+			cache_writeback (e);
+			continue;
+		}
+
+		miss_cnt++;
+		e->sector = sector;
+		e->valid = false;
+		e->dirty = false;
+		e->accessed = true;
+		e->users = 1;
+		if (fill) {
+			e->io = true;
+			lock_release (&cache_lock);
+			disk_read (filesys_disk, sector, e->data);
+			lock_acquire (&cache_lock);
+			e->io = false;
+			e->valid = true;
+			cond_broadcast (&cache_changed, &cache_lock);
+		}
+		return e;
+	}
+}
+
+/* Drops the reference to E taken by cache_get(). */
+static void
+cache_put (struct cache_entry *e) {
+	ASSERT (lock_held_by_current_thread (&cache_lock));
+	ASSERT (e->users > 0);
+
+	if (--e->users == 0)
+		cond_broadcast (&cache_changed, &cache_lock);
+}
+
+/* Copies SIZE bytes starting at byte OFS of SECTOR into BUFFER.
+ * BUFFER may be a user page, so the copy is done without holding
+ * CACHE_LOCK. */
+void
+page_cache_read (disk_sector_t sector, void *buffer, off_t ofs,
+		size_t size) {
+	struct cache_entry *e;
+
+	ASSERT (ofs >= 0 && ofs + size <= DISK_SECTOR_SIZE);
+
+	lock_acquire (&cache_lock);
+	e = cache_get (sector, true);
+	lock_release (&cache_lock);
+
+	memcpy (buffer, e->data + ofs, size);
+
+	lock_acquire (&cache_lock);
+	cache_put (e);
+	lock_release (&cache_lock);
+}
+
+/* Copies SIZE bytes from BUFFER into SECTOR starting at byte OFS.
+ * The sector reaches the disk on eviction, from the write-behind
+ * thread, or from page_cache_flush(). */
+void
+page_cache_write (disk_sector_t sector, const void *buffer, off_t ofs,
+		size_t size) {
+	struct cache_entry *e;
+	bool whole = ofs == 0 && size == DISK_SECTOR_SIZE;
+
+	ASSERT (ofs >= 0 && ofs + size <= DISK_SECTOR_SIZE);
+
+	lock_acquire (&cache_lock);
+	e = cache_get (sector, !whole);
+	lock_release (&cache_lock);
+
+	memcpy (e->data + ofs, buffer, size);
+
+	lock_acquire (&cache_lock);
+	if (!e->valid) {
+		e->valid = true;
+		cond_broadcast (&cache_changed, &cache_lock);
+	}
+	e->dirty = true;
+	cache_put (e);
+	lock_release (&cache_lock);
+}
+
+/* Queues SECTOR to be read into the cache in the background.
+ * Does nothing if it is already cached or queued, or if the queue
+ * is full. */
+void
+page_cache_prefetch (disk_sector_t sector) {
+	size_t i;
+	bool queued = false;
+
+	lock_acquire (&cache_lock);
+	if (cache_lookup (sector) == NULL
+			&& ra_tail - ra_head < RA_QUEUE_SIZE) {
+		for (i = ra_head; i != ra_tail; i++)
+			if (ra_queue[i % RA_QUEUE_SIZE] == sector)
+				break;
+		if (i == ra_tail) {
+			ra_queue[ra_tail++ % RA_QUEUE_SIZE] = sector;
+			queued = true;
+		}
+	}
+	lock_release (&cache_lock);
+
+	if (queued)
+		sema_up (&ra_sema);
+}
+
+/* Returns true if E caches one of the CNT sectors starting at
+ * SECTOR. */
+static bool
+cache_in_range (const struct cache_entry *e, disk_sector_t sector,
+		size_t cnt) {
+	return e->sector != SECTOR_NONE && e->sector - sector < cnt;
+}
+
+/* Drops the cached copies of the CNT sectors starting at SECTOR
+ * without writing them back, except for dirty ones if KEEP_DIRTY.
+ * Must be called with CACHE_LOCK held. */
+static void
+cache_drop (disk_sector_t sector, size_t cnt, bool keep_dirty) {
+	size_t i;
+
+	ASSERT (lock_held_by_current_thread (&cache_lock));
+
+	for (i = 0; i < PAGE_CACHE_SIZE; i++) {
+		struct cache_entry *e = &cache[i];
+
+		while (cache_in_range (e, sector, cnt) && (e->io || e->users > 0))
+			cond_wait (&cache_changed, &cache_lock);
+		if (cache_in_range (e, sector, cnt) && !(keep_dirty && e->dirty)) {
+			e->sector = SECTOR_NONE;
+			e->valid = false;
+			e->dirty = false;
+		}
+	}
+}
+
+/* Drops any cached copies of the CNT sectors starting at SECTOR
+ * without writing them back, for a caller about to write those
+ * sectors on disk directly. */
+void
+page_cache_discard (disk_sector_t sector, size_t cnt) {
+	lock_acquire (&cache_lock);
+	cache_drop (sector, cnt, false);
+	lock_release (&cache_lock);
+}
+
+/* Returns the number of sectors from SECTOR on, up to CNT, that
+ * are not cached.  Must be called with CACHE_LOCK held. */
+static size_t
+cache_uncached_run (disk_sector_t sector, size_t cnt) {
+	size_t n = 0;
+
+	while (n < cnt && cache_lookup (sector + n) == NULL)
+		n++;
+	return n;
+}
+
+/* Reads the CNT whole sectors starting at SECTOR into BUFFER.
+ * Sectors in the cache are copied from it; the others are read
+ * from disk straight into BUFFER, as few commands as possible, and
+ * are not cached.  BUFFER must not fault, e.g. because it is a
+ * pinned user buffer. */
+void
+page_cache_read_direct (disk_sector_t sector, void *buffer_, size_t cnt) {
+	uint8_t *buffer = buffer_;
+	size_t i = 0;
+
+	while (i < cnt) {
+		size_t n;
+
+		lock_acquire (&cache_lock);
+		n = cache_uncached_run (sector + i, cnt - i);
+		if (n > 0)
+			direct_cnt += n;
+		lock_release (&cache_lock);
+
+		if (n == 0) {
+			page_cache_read (sector + i, buffer + i * DISK_SECTOR_SIZE, 0,
+					DISK_SECTOR_SIZE);
+			i++;
+		} else {
+			disk_read_multi (filesys_disk, sector + i, n,
+					buffer + i * DISK_SECTOR_SIZE);
+			i += n;
+		}
+	}
+}
+
+/* Writes the CNT whole sectors starting at SECTOR from BUFFER.
+ * Sectors in the cache are updated there; the others are written
+ * from BUFFER straight to disk.  A clean copy cached by a read that
+ * raced with the disk write may be stale, so it is dropped
+ * afterward; a dirty one is newer than this write and stays.
+ * BUFFER must not fault. */
+void
+page_cache_write_direct (disk_sector_t sector, const void *buffer_,
+		size_t cnt) {
+	const uint8_t *buffer = buffer_;
+	size_t i = 0;
+
+	while (i < cnt) {
+		size_t n;
+
+		lock_acquire (&cache_lock);
+		n = cache_uncached_run (sector + i, cnt - i);
+		if (n > 0)
+			direct_cnt += n;
+		lock_release (&cache_lock);
+
+		if (n == 0) {
+			page_cache_write (sector + i, buffer + i * DISK_SECTOR_SIZE, 0,
+					DISK_SECTOR_SIZE);
+			i++;
+		} else {
+			disk_write_multi (filesys_disk, sector + i, n,
+					buffer + i * DISK_SECTOR_SIZE);
+			lock_acquire (&cache_lock);
+			cache_drop (sector + i, n, true);
+			lock_release (&cache_lock);
+			i += n;
+		}
+	}
+}
+
+/* Writes every dirty sector back to disk.  All of the writes are
+ * queued on the disk at once and then waited for together. */
+void
+page_cache_flush (void) {
+	bool queued[PAGE_CACHE_SIZE];
+	struct semaphore done;
+	size_t i, cnt = 0;
+
+	sema_init (&done, 0);
+	lock_acquire (&cache_lock);
+	for (i = 0; i < PAGE_CACHE_SIZE; i++) {
+		struct cache_entry *e = &cache[i];
+
+		while (e->io)
+			cond_wait (&cache_changed, &cache_lock);
+		queued[i] = e->valid && e->dirty;
+		if (queued[i]) {
+			e->io = true;
+			e->dirty = false;
+			writeback_cnt++;
+			disk_request_init (&e->req, filesys_disk, e->sector, 1, e->data,
+					true);
+			e->req.sema = &done;
+			disk_submit (&e->req);
+			cnt++;
+		}
+	}
+	lock_release (&cache_lock);
+
+	while (cnt-- > 0)
+		sema_down (&done);
+
+	lock_acquire (&cache_lock);
+	for (i = 0; i < PAGE_CACHE_SIZE; i++)
+		if (queued[i])
+			cache[i].io = false;
+	cond_broadcast (&cache_changed, &cache_lock);
+	lock_release (&cache_lock);
+}
+
+/* Prints buffer cache statistics. */
+void
+page_cache_print_stats (void) {
+	printf ("Buffer cache: %lld hits, %lld misses, %lld read-ahead, "
+			"%lld write-backs, %lld direct\n",
+			hit_cnt, miss_cnt, readahead_cnt, writeback_cnt, direct_cnt);
 }
 
 /* Initialize the page cache */
 bool
-page_cache_initializer (struct page *page, enum vm_type type, void *kva) {
+page_cache_initializer (struct page *page, enum vm_type type UNUSED,
+		void *kva UNUSED) {
 	/* Set up the handler */
 	page->operations = &page_cache_op;
-
+	return true;
 }
 
 /* Utilze the Swap in mechanism to implement readhead */
 static bool
-page_cache_readahead (struct page *page, void *kva) {
+page_cache_readahead (struct page *page UNUSED, void *kva UNUSED) {
+	/* File data is cached per sector by page_cache_read(); no page
+	 * of this type is ever created. */
+	return false;
 }
 
 /* Utilze the Swap out mechanism to implement writeback */
 static bool
-page_cache_writeback (struct page *page) {
+page_cache_writeback (struct page *page UNUSED) {
+	return false;
 }
 
 /* Destory the page_cache. */
 static void
-page_cache_destroy (struct page *page) {
+page_cache_destroy (struct page *page UNUSED) {
+}
+
+/* Worker thread for page cache.
+ * Reads the sectors queued by page_cache_prefetch(). */
+static void
+page_cache_kworkerd (void *aux UNUSED) {
+	for (;;) {
+		struct cache_entry *e;
+		disk_sector_t sector;
+
+		sema_down (&ra_sema);
+
+		lock_acquire (&cache_lock);
+		sector = ra_queue[ra_head++ % RA_QUEUE_SIZE];
+		if (cache_lookup (sector) == NULL) {
+			e = cache_get (sector, true);
+			readahead_cnt++;
+			/* Let the clock give the sector one pass before it may
+			 * be evicted unread. */
+			cache_put (e);
+		}
+		lock_release (&cache_lock);
+	}
 }
 
-/* Worker thread for page cache */
+/* Write-behind thread.
+ * Periodically writes dirty sectors back so that a crash loses
+ * at most WRITE_BEHIND_MS worth of writes.  The free map, which
+ * is kept in memory, is pushed into the cache first. */
 static void
-page_cache_kworkerd (void *aux) {
+page_cache_flusherd (void *aux UNUSED) {
+	for (;;) {
+		timer_msleep (WRITE_BEHIND_MS);
+		free_map_flush ();
+		page_cache_flush ();
+	}
 }
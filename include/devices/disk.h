@@ -2,6 +2,9 @@
 #define DEVICES_DISK_H
 
 #include <inttypes.h>
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 /* Size of a disk sector in bytes. */
@@ -15,13 +18,55 @@ typedef uint32_t disk_sector_t;
  * printf ("sector=%"PRDSNu"\n", sector); */
 #define PRDSNu PRIu32
 
+/* Most sectors a single disk_read_multi() or disk_write_multi()
+ * can transfer. */
+#define DISK_MULTI_MAX 256
+
+struct disk_request;
+struct semaphore;
+
+/* Called when a disk request completes.  Runs in the disk's
+ * interrupt handler or with interrupts off, so it must not sleep. */
+typedef void disk_done_func (struct disk_request *);
+
+/* A transfer of CNT consecutive sectors between a disk and memory,
+ * queued by disk_submit().  The request and its buffer must stay
+ * put until it completes. */
+struct disk_request {
+	struct disk *disk;          /* Disk to transfer to or from. */
+	disk_sector_t sector;       /* First sector. */
+	size_t cnt;                 /* Sectors, 1 to DISK_MULTI_MAX. */
+	void *buffer;               /* CNT * DISK_SECTOR_SIZE bytes. */
+	bool write;                 /* Write BUFFER to disk? Else read. */
+
+	disk_done_func *done;       /* Called on completion, or NULL. */
+	void *aux;                  /* For DONE's use. */
+	struct semaphore *sema;     /* Up'd on completion, or NULL. */
+
+	/* Owned by the disk driver while the request is queued. */
+	struct list_elem elem;      /* Channel queue element. */
+	int64_t deadline;           /* Timer tick by which to serve it. */
+	uint64_t start;             /* TSC when submitted. */
+	bool by_caller;             /* Data moved by the submitting thread? */
+};
+
+/* Use bus master DMA transfers if available.
+ * If false (default), use programmed I/O. */
+extern bool disk_use_dma;
+
 void disk_init (void);
 void disk_print_stats (void);
+void disk_print_sched_stats (void);
 
 struct disk *disk_get (int chan_no, int dev_no);
 disk_sector_t disk_size (struct disk *);
 void disk_read (struct disk *, disk_sector_t, void *);
 void disk_write (struct disk *, disk_sector_t, const void *);
+void disk_read_multi (struct disk *, disk_sector_t, size_t cnt, void *);
+void disk_write_multi (struct disk *, disk_sector_t, size_t cnt, const void *);
+void disk_request_init (struct disk_request *, struct disk *, disk_sector_t,
+		size_t cnt, void *buffer, bool write);
+void disk_submit (struct disk_request *);
 
 void 	register_disk_inspect_intr ();
 #endif /* devices/disk.h */
@@ -0,0 +1,19 @@
+#ifndef FILESYS_DCACHE_H
+#define FILESYS_DCACHE_H
+
+#include <stdbool.h>
+#include "devices/disk.h"
+
+/* Directory entry cache.
+ * Maps (directory inode sector, name) to the inode sector the
+ * name refers to, or records that the name does not exist. */
+
+void dcache_init (void);
+bool dcache_lookup (disk_sector_t dir, const char *name, bool *found,
+		disk_sector_t *sector);
+void dcache_insert (disk_sector_t dir, const char *name, disk_sector_t sector);
+void dcache_insert_negative (disk_sector_t dir, const char *name);
+void dcache_invalidate (disk_sector_t dir, const char *name);
+void dcache_invalidate_dir (disk_sector_t dir);
+
+#endif /* filesys/dcache.h */
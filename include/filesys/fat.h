@@ -33,6 +33,9 @@ void fat_remove_chain (
 );
 cluster_t fat_get (cluster_t clst);
 void fat_put (cluster_t clst, cluster_t val);
+cluster_t fat_chain_nth (cluster_t start, size_t idx);
+size_t fat_free_cnt (void);
 disk_sector_t cluster_to_sector (cluster_t clst);
+cluster_t sector_to_cluster (disk_sector_t sector);
 
 #endif /* filesys/fat.h */
@@ -1,9 +1,12 @@
 #ifndef FILESYS_FILE_H
 #define FILESYS_FILE_H
 
+#include <stdbool.h>
+#include <stddef.h>
 #include "filesys/off_t.h"
 
 struct inode;
+struct iovec;
 
 /* Opening and closing files. */
 struct file *file_open (struct inode *);
@@ -17,6 +20,12 @@ off_t file_read (struct file *, void *, off_t);
 off_t file_read_at (struct file *, void *, off_t size, off_t start);
 off_t file_write (struct file *, const void *, off_t);
 off_t file_write_at (struct file *, const void *, off_t size, off_t start);
+off_t file_read_direct (struct file *, void *, off_t);
+off_t file_write_direct (struct file *, const void *, off_t);
+void file_set_direct (struct file *);
+off_t file_readv (struct file *, const struct iovec *, size_t cnt);
+off_t file_writev (struct file *, const struct iovec *, size_t cnt);
+bool file_fill (struct file *, off_t size, off_t start);
 
 /* Preventing writes. */
 void file_deny_write (struct file *);
@@ -2,10 +2,12 @@
 #define FILESYS_INODE_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include "filesys/off_t.h"
 #include "devices/disk.h"
 
 struct bitmap;
+struct iovec;
 
 void inode_init (void);
 bool inode_create (disk_sector_t, off_t);
@@ -16,6 +18,14 @@ void inode_close (struct inode *);
 void inode_remove (struct inode *);
 off_t inode_read_at (struct inode *, void *, off_t size, off_t offset);
 off_t inode_write_at (struct inode *, const void *, off_t size, off_t offset);
+off_t inode_read_direct (struct inode *, void *, off_t size, off_t offset);
+off_t inode_write_direct (struct inode *, const void *, off_t size,
+		off_t offset);
+off_t inode_readv (struct inode *, const struct iovec *, size_t cnt,
+		off_t offset);
+off_t inode_writev (struct inode *, const struct iovec *, size_t cnt,
+		off_t offset);
+bool inode_fill (struct inode *, off_t offset, off_t size);
 void inode_deny_write (struct inode *);
 void inode_allow_write (struct inode *);
 off_t inode_length (const struct inode *);
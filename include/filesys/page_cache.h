@@ -1,12 +1,29 @@
 #ifndef FILESYS_PAGE_CACHE_H
 #define FILESYS_PAGE_CACHE_H
-#include "vm/vm.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include "devices/disk.h"
+#include "filesys/off_t.h"
 
 struct page;
 enum vm_type;
 
 struct page_cache {};
 
+/* Number of sectors held by the buffer cache. */
+#define PAGE_CACHE_SIZE 64
+
 void page_cache_init (void);
+void page_cache_read (disk_sector_t sector, void *buffer, off_t ofs,
+		size_t size);
+void page_cache_write (disk_sector_t sector, const void *buffer, off_t ofs,
+		size_t size);
+void page_cache_read_direct (disk_sector_t sector, void *buffer, size_t cnt);
+void page_cache_write_direct (disk_sector_t sector, const void *buffer,
+		size_t cnt);
+void page_cache_prefetch (disk_sector_t sector);
+void page_cache_discard (disk_sector_t sector, size_t cnt);
+void page_cache_flush (void);
+void page_cache_print_stats (void);
 bool page_cache_initializer (struct page *page, enum vm_type type, void *kva);
 #endif
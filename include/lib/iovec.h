@@ -0,0 +1,15 @@
+#ifndef __LIB_IOVEC_H
+#define __LIB_IOVEC_H
+
+#include <stddef.h>
+
+/* One piece of a scattered buffer for readv() and writev(). */
+struct iovec {
+	void *iov_base;             /* Start of the piece. */
+	size_t iov_len;             /* Number of bytes in it. */
+};
+
+/* Most pieces that one readv() or writev() takes. */
+#define IOV_MAX 64
+
+#endif /* lib/iovec.h */
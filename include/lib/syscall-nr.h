@@ -36,6 +36,12 @@ enum {
 
 	SYS_MOUNT,
 	SYS_UMOUNT,
+
+	/* Vectored and positional I/O. */
+	SYS_READV,                  /* Read a file into several buffers. */
+	SYS_WRITEV,                 /* Write several buffers to a file. */
+	SYS_PREAD,                  /* Read from a file at an offset. */
+	SYS_PWRITE,                 /* Write to a file at an offset. */
 };
 
 #endif /* lib/syscall-nr.h */
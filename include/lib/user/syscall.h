@@ -4,6 +4,7 @@
 #include <stdbool.h>
 #include <debug.h>
 #include <stddef.h>
+#include <iovec.h>
 
 /* Process identifier. */
 typedef int pid_t;
@@ -36,6 +37,11 @@ void seek (int fd, unsigned position);
 unsigned tell (int fd);
 void close (int fd);
 
+int readv (int fd, const struct iovec *iov, int iovcnt);
+int writev (int fd, const struct iovec *iov, int iovcnt);
+int pread (int fd, void *buffer, unsigned length, off_t offset);
+int pwrite (int fd, const void *buffer, unsigned length, off_t offset);
+
 int dup2(int oldfd, int newfd);
 
 /* Project 3 and optionally project 4. */
@@ -78,4 +84,22 @@ get_fs_disk_write_cnt (void) {
 	return write_cnt;
 }
 
+static inline long long
+get_page_fault_cnt (void) {
+	long long fault_cnt;
+	asm volatile ("movq $0, %rdx");
+	asm volatile ("int $0x45");
+	asm volatile ("\t movq %%rax, %0": "=r" (fault_cnt));
+	return fault_cnt;
+}
+
+static inline long long
+get_major_fault_cnt (void) {
+	long long fault_cnt;
+	asm volatile ("movq $1, %rdx");
+	asm volatile ("int $0x45");
+	asm volatile ("\t movq %%rax, %0": "=r" (fault_cnt));
+	return fault_cnt;
+}
+
 #endif /* lib/user/syscall.h */
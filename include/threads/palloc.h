@@ -18,6 +18,10 @@ uint64_t palloc_init (void);
 void *palloc_get_page (enum palloc_flags);
 void *palloc_get_multiple (enum palloc_flags, size_t page_cnt);
 void palloc_free_page (void *);
+void *palloc_user_pool_range (size_t *page_cnt);
+size_t palloc_user_free_cnt (void);
 void palloc_free_multiple (void *, size_t page_cnt);
+void page_copy (void *dst, const void *src);
+void page_zero (void *page);
 
 #endif /* threads/palloc.h */
@@ -44,6 +44,20 @@ void cond_wait (struct condition *, struct lock *);
 void cond_signal (struct condition *, struct lock *);
 void cond_broadcast (struct condition *, struct lock *);
 
+/* Readers-writer lock. */
+struct rwlock {
+	struct lock lock;           /* Protects the members below. */
+	struct condition changed;   /* Signaled when RW is released. */
+	int readers;                /* Number of readers holding RW. */
+	bool writer;                /* True while a writer holds RW. */
+};
+
+void rwlock_init (struct rwlock *);
+void rwlock_acquire_read (struct rwlock *);
+void rwlock_release_read (struct rwlock *);
+void rwlock_acquire_write (struct rwlock *);
+void rwlock_release_write (struct rwlock *);
+
 // * Semaphore 추가 함수
 bool cmp_sem_priority(const struct list_elem *a, const struct list_elem *b, void *aux);
 
@@ -6,6 +6,7 @@
 #include <stdint.h>
 #include <limits.h>
 #include "threads/interrupt.h"
+#include "threads/fixed_point.h"
 #ifdef VM
 #include "vm/vm.h"
 #endif
@@ -34,6 +35,11 @@ typedef int tid_t;
 #define PRI_DEFAULT 31                  /* Default priority. */
 #define PRI_MAX 63                      /* Highest priority. */
 
+/* Thread niceness, for the MLFQS. */
+#define NICE_MIN -20                    /* Nicest to other threads. */
+#define NICE_DEFAULT 0                  /* Default niceness. */
+#define NICE_MAX 20                     /* Least nice. */
+
 #define FD_MAX 128
 /* A kernel thread or user process.
  *
@@ -98,11 +104,14 @@ struct thread {
 	enum thread_status status;          /* Thread state. */
 	char name[16];                      /* Name (for debugging purposes). */
 	int priority;                       /* Priority. */
-	int wakeup_tick;					/* Wake up tick */
+	int64_t wakeup_tick;				/* Wake up tick */
 	int init_priority;					/* initial priority before priority donation */
 	struct lock *wait_on_lock;			/* lock, thread waiting for */
 	struct list donations;				/* list for multi donation */
 	struct list_elem donation_elem;		/* list_elem for donation list */
+	int nice;							/* Niceness, for the MLFQS. */
+	fixed_t recent_cpu;					/* Recent CPU usage, for the MLFQS. */
+	struct list_elem all_elem;			/* List element for all threads list. */
 	/* Shared between thread.c and synch.c. */
 	struct list_elem elem;              /* List element. */
 
@@ -164,8 +173,6 @@ void thread_yield (void);
 
 void thread_sleep(int64_t ticks);
 void thread_awake(int64_t ticks);
-void update_next_tick_to_awake(int64_t ticks);
-int64_t get_next_tick_to_awake(void);
 
 int thread_get_priority (void);
 void thread_set_priority (int);
@@ -181,6 +188,7 @@ void do_iret (struct intr_frame *tf);
 void test_max_priority (void);
 bool cmp_priority (const struct list_elem *a, const struct list_elem *b, void *aux UNUSED);
 bool preempt_by_priority(void);
+void thread_change_priority (struct thread *, int priority);
 
 // * priority donation 추가 함수
 void donate_priority(void);
@@ -1,12 +1,13 @@
 // * USERPROG 추가
 #include <stdbool.h>
 #include "threads/thread.h"
+#include "filesys/off_t.h"
+
+struct iovec;
 
 #ifndef USERPROG_SYSCALL_H
 #define USERPROG_SYSCALL_H
 
-struct lock filesys_lock;
-
 void syscall_init (void);
 
 // * 추가
@@ -26,13 +27,15 @@ int open (const char *file);
 int filesize (int fd);
 int read (int fd, void *buffer, unsigned size);
 int write(int fd, const void *buffer, unsigned size);
+int readv (int fd, const struct iovec *iov, int iovcnt);
+int writev (int fd, const struct iovec *iov, int iovcnt);
+int pread (int fd, void *buffer, unsigned size, off_t offset);
+int pwrite (int fd, const void *buffer, unsigned size, off_t offset);
 void seek (int fd, unsigned position);
 unsigned tell (int fd);
 void close (int fd);
 void *mmap (void *addr, size_t length, int writable, int fd, off_t offset);
 void munmap (void *addr);
-off_t file_write_with_lock (struct file *file, void *buffer, off_t size, off_t file_ofs);
-off_t file_read_with_lock (struct file *file, void *buffer, off_t size, off_t file_ofs);
 
 
 
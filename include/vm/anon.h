@@ -8,7 +8,10 @@ enum vm_type;
 struct anon_page {
 };
 
+/* Value of page->swap_slot for an anonymous page that is not in swap. */
+#define SWAP_SLOT_NONE ((disk_sector_t) -1)
+
 void vm_anon_init (void);
 bool anon_initializer (struct page *page, enum vm_type type, void *kva);
-bool anon_child_swap_in (struct page *parent_page, void *kva);
+void anon_swap_share (struct page *dst, struct page *src);
 #endif
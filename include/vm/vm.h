@@ -37,9 +37,6 @@ struct thread;
 
 #define VM_TYPE(type) ((type) & 7)
 
-struct list frame_table;
-struct list_elem *lru_clock;
-
 /* The representation of "page".
  * This is kind of "parent class", which has four "child class"es, which are
  * uninit_page, file_page, anon_page, and page cache (project4).
@@ -65,6 +62,9 @@ struct page {
 	
 	disk_sector_t swap_slot;
 
+	uint64_t *pml4;              /* Page table the page is mapped in. */
+	struct list_elem frame_elem; /* Element in the frame's page list. */
+
 	/* Per-type data are binded into the union.
 	 * Each function automatically detects the current union */
 	union {
@@ -86,11 +86,21 @@ struct file_info {
 	size_t zero_bytes; 
 };
 
-/* The representation of "frame" */
+/* The representation of "frame".
+ * There is one of these for every page of the user pool, kept in an array
+ * indexed by the page's position in the pool, so frame_lookup() finds the
+ * frame for a kernel address in constant time.  KVA is null while the
+ * page is not allocated.
+ * After fork a frame may be shared copy-on-write by several pages, each
+ * mapped read-only in its own page table.  PAGES lists every one of them
+ * (the reverse mapping: each page records its pml4 and va) and REF_CNT is
+ * its length. */
 struct frame {
 	void *kva;
-	struct page *page;
-	struct list_elem frame_elem;
+	struct list pages;
+	int ref_cnt;
+	int pin_cnt;                 /* Pinned frames are never evicted. */
+	bool evicting;               /* Being written out by vm_evict_frame(). */
 };
 
 struct mmap_file {
@@ -122,6 +132,13 @@ struct page_operations {
  * All designs up to you for this. */
 struct supplemental_page_table {
 	struct hash hash_page_table;
+
+	/* Read-ahead state for file-backed faults; see vm_read_ahead(). */
+	void *ra_end;                /* First page after the last window. */
+	size_t ra_window;            /* Pages to read ahead next time. */
+
+	size_t fault_cnt;            /* Page faults taken on user addresses. */
+	size_t major_fault_cnt;      /* Of those, faults that loaded a page. */
 };
 
 #include "threads/thread.h"
@@ -145,8 +162,15 @@ bool vm_alloc_page_with_initializer (enum vm_type type, void *upage,
 void vm_dealloc_page (struct page *page);
 void delete_page (struct page *page);
 bool vm_claim_page (void *va);
+bool vm_pin_buffer (void *buffer, size_t size, bool write);
+void vm_unpin_buffer (void *buffer, size_t size);
 enum vm_type page_get_type (struct page *page);
 
+extern size_t kswapd_low;
+extern size_t kswapd_high;
+extern size_t kswapd_zero;
+
+struct frame *frame_lookup(const void *kva);
 void free_frame(void *kva);
 void delete_frame(struct page *p);
 
@@ -156,8 +180,6 @@ struct page *page_lookup (const void *address);
 static hash_action_func delete_elem;
 static hash_action_func copy_elem;
 
-void add_frame_to_frame_table(struct frame *frame);
-void del_frame_from_frame_table(struct frame *frame);
 void try_to_free_frames(enum palloc_flags flags);
 
 #endif  /* VM_VM_H */
@@ -64,6 +64,30 @@ last_mask (const struct bitmap *b) {
 	return last_bits ? ((elem_type) 1 << last_bits) - 1 : (elem_type) -1;
 }
 
+/* Returns the index of the first bit in B at or after START that
+   is set to VALUE, or B's size if there is none.  Whole elements
+   that hold no such bit are skipped a word at a time. */
+static size_t
+next_bit (const struct bitmap *b, size_t start, bool value) {
+	elem_type flip = value ? 0 : (elem_type) -1;
+	size_t idx = elem_idx (start);
+	size_t bit;
+	elem_type e;
+
+	if (start >= b->bit_cnt)
+		return b->bit_cnt;
+
+	/* Bits of VALUE become 1 bits; those below START are dropped. */
+	e = (b->bits[idx] ^ flip) & ~(bit_mask (start) - 1);
+	while (e == 0) {
+		if (++idx >= elem_cnt (b->bit_cnt))
+			return b->bit_cnt;
+		e = b->bits[idx] ^ flip;
+	}
+	bit = idx * ELEM_BITS + __builtin_ctzl (e);
+	return bit < b->bit_cnt ? bit : b->bit_cnt;
+}
+
 /* Creation and destruction. */
 
 /* Initializes B to be a bitmap of BIT_CNT bits
@@ -229,16 +253,11 @@ bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value) {
    exclusive, are set to VALUE, and false otherwise. */
 bool
 bitmap_contains (const struct bitmap *b, size_t start, size_t cnt, bool value) {
-	size_t i;
-
 	ASSERT (b != NULL);
 	ASSERT (start <= b->bit_cnt);
 	ASSERT (start + cnt <= b->bit_cnt);
 
-	for (i = 0; i < cnt; i++)
-		if (bitmap_test (b, start + i) == value)
-			return true;
-	return false;
+	return cnt > 0 && next_bit (b, start, value) < start + cnt;
 }
 
 /* Returns true if any bits in B between START and START + CNT,
@@ -267,22 +286,52 @@ bitmap_all (const struct bitmap *b, size_t start, size_t cnt) {
 /* Finds and returns the starting index of the first group of CNT
    consecutive bits in B at or after START that are all set to
    VALUE.
-   If there is no such group, returns BITMAP_ERROR. */
+   If there is no such group, returns BITMAP_ERROR.
+   Jumps from one run of VALUE bits to the next instead of trying
+   every starting bit, so the cost is linear in the size of B. */
 size_t
 bitmap_scan (const struct bitmap *b, size_t start, size_t cnt, bool value) {
+	size_t i;
+
 	ASSERT (b != NULL);
 	ASSERT (start <= b->bit_cnt);
 
-	if (cnt <= b->bit_cnt) {
-		size_t last = b->bit_cnt - cnt;
-		size_t i;
-		for (i = start; i <= last; i++)
-			if (!bitmap_contains (b, i, cnt, !value))
-				return i;
+	if (cnt > b->bit_cnt)
+		return BITMAP_ERROR;
+	if (cnt == 0)
+		return start;
+
+	for (i = next_bit (b, start, value); i <= b->bit_cnt - cnt;
+			i = next_bit (b, i, value)) {
+		size_t end = next_bit (b, i, !value);
+		if (end - i >= cnt)
+			return i;
+		i = end;
 	}
 	return BITMAP_ERROR;
 }
 
+/* Finds the first run of bits in B at or after START that are
+   all set to VALUE, stores its length in *CNT, and returns the
+   index of its first bit.  The run extends as far as it goes,
+   up to the end of B.
+   If there is no such bit, returns BITMAP_ERROR. */
+size_t
+bitmap_scan_run (const struct bitmap *b, size_t start, bool value,
+		size_t *cnt) {
+	size_t i;
+
+	ASSERT (b != NULL);
+	ASSERT (start <= b->bit_cnt);
+	ASSERT (cnt != NULL);
+
+	i = next_bit (b, start, value);
+	if (i == b->bit_cnt)
+		return BITMAP_ERROR;
+	*cnt = next_bit (b, i, !value) - i;
+	return i;
+}
+
 /* Finds the first group of CNT consecutive bits in B at or after
    START that are all set to VALUE, flips them all to !VALUE,
    and returns the index of the first bit in the group.
@@ -327,6 +376,23 @@ bitmap_write (const struct bitmap *b, struct file *file) {
 	off_t size = byte_cnt (b->bit_cnt);
 	return file_write_at (file, b->bits, size, 0) == size;
 }
+
+/* Writes the part of B that lies in bytes OFS through OFS + SIZE
+   of its file image, as written by bitmap_write(), to the same
+   place in FILE.  The range is clipped to the end of the image.
+   Return true if successful, false otherwise. */
+bool
+bitmap_write_part (const struct bitmap *b, struct file *file,
+		size_t ofs, size_t size) {
+	size_t file_size = byte_cnt (b->bit_cnt);
+
+	if (ofs >= file_size)
+		return true;
+	if (size > file_size - ofs)
+		size = file_size - ofs;
+	return file_write_at (file, (const uint8_t *) b->bits + ofs, size, ofs)
+		== (off_t) size;
+}
 #endif /* FILESYS */
 
 /* Debugging. */
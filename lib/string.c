@@ -1,5 +1,72 @@
 #include <string.h>
 #include <debug.h>
+#include <stdint.h>
+
+/* The block functions below move and compare eight bytes at a time
+   with the string instructions, which is many times faster than a
+   byte loop, especially as Pintos is built without optimization.
+   SSE would be faster still, but the kernel is built with -mno-sse
+   and does not save SSE state, so these stay in general-purpose
+   registers. */
+
+/* Blocks shorter than this are handled a byte at a time. */
+#define WORD_MIN 16
+
+/* A 64-bit word that may be loaded from any address. */
+typedef uint64_t __attribute__ ((__may_alias__, __aligned__ (1))) word_t;
+
+/* Copies SIZE bytes forward from SRC to DST, eight bytes at a
+   time once DST is aligned.  Safe for overlapping blocks as long
+   as DST is below SRC. */
+static void
+copy_forward (unsigned char *dst, const unsigned char *src, size_t size) {
+	if (size >= WORD_MIN) {
+		size_t head = -(uintptr_t) dst % sizeof (uint64_t);
+		size_t words;
+
+		size -= head;
+		while (head-- > 0)
+			*dst++ = *src++;
+		words = size / sizeof (uint64_t);
+		size %= sizeof (uint64_t);
+		asm volatile ("rep movsq"
+				: "+D" (dst), "+S" (src), "+c" (words) : : "memory");
+	}
+	while (size-- > 0)
+		*dst++ = *src++;
+}
+
+/* Copies SIZE bytes backward from the end of SRC to the end of
+   DST, eight bytes at a time once the ends are aligned.  Safe for
+   overlapping blocks as long as DST is above SRC. */
+static void
+copy_backward (unsigned char *dst, const unsigned char *src, size_t size) {
+	dst += size;
+	src += size;
+	if (size >= WORD_MIN) {
+		size_t tail = (uintptr_t) dst % sizeof (uint64_t);
+		size_t words;
+
+		size -= tail;
+		while (tail-- > 0)
+			*--dst = *--src;
+		words = size / sizeof (uint64_t);
+		size %= sizeof (uint64_t);
+		if (words > 0) {
+			/* With the direction flag set, MOVSQ starts at the last
+			   word and works down. */
+			unsigned char *d = dst - sizeof (uint64_t);
+			const unsigned char *s = src - sizeof (uint64_t);
+
+			asm volatile ("std; rep movsq; cld"
+					: "+D" (d), "+S" (s), "+c" (words) : : "memory");
+			dst = d + sizeof (uint64_t);
+			src = s + sizeof (uint64_t);
+		}
+	}
+	while (size-- > 0)
+		*--dst = *--src;
+}
 
 /* Copies SIZE bytes from SRC to DST, which must not overlap.
    Returns DST. */
@@ -11,8 +78,7 @@ memcpy (void *dst_, const void *src_, size_t size) {
 	ASSERT (dst != NULL || size == 0);
 	ASSERT (src != NULL || size == 0);
 
-	while (size-- > 0)
-		*dst++ = *src++;
+	copy_forward (dst, src, size);
 
 	return dst_;
 }
@@ -27,17 +93,12 @@ memmove (void *dst_, const void *src_, size_t size) {
 	ASSERT (dst != NULL || size == 0);
 	ASSERT (src != NULL || size == 0);
 
-	if (dst < src) {
-		while (size-- > 0)
-			*dst++ = *src++;
-	} else {
-		dst += size;
-		src += size;
-		while (size-- > 0)
-			*--dst = *--src;
-	}
+	if (dst < src)
+		copy_forward (dst, src, size);
+	else if (dst > src)
+		copy_backward (dst, src, size);
 
-	return dst;
+	return dst_;
 }
 
 /* Find the first differing byte in the two blocks of SIZE bytes
@@ -52,6 +113,14 @@ memcmp (const void *a_, const void *b_, size_t size) {
 	ASSERT (a != NULL || size == 0);
 	ASSERT (b != NULL || size == 0);
 
+	/* Skip the equal words; the byte loop finds the difference
+	   within the first word that differs. */
+	while (size >= sizeof (uint64_t)
+			&& *(const word_t *) a == *(const word_t *) b) {
+		a += sizeof (uint64_t);
+		b += sizeof (uint64_t);
+		size -= sizeof (uint64_t);
+	}
 	for (; size-- > 0; a++, b++)
 		if (*a != *b)
 			return *a > *b ? +1 : -1;
@@ -260,6 +329,19 @@ memset (void *dst_, int value, size_t size) {
 
 	ASSERT (dst != NULL || size == 0);
 
+	if (size >= WORD_MIN) {
+		size_t head = -(uintptr_t) dst % sizeof (uint64_t);
+		uint64_t word = 0x0101010101010101ULL * (unsigned char) value;
+		size_t words;
+
+		size -= head;
+		while (head-- > 0)
+			*dst++ = value;
+		words = size / sizeof (uint64_t);
+		size %= sizeof (uint64_t);
+		asm volatile ("rep stosq"
+				: "+D" (dst), "+c" (words) : "a" (word) : "memory");
+	}
 	while (size-- > 0)
 		*dst++ = value;
 
@@ -0,0 +1,49 @@
+/* Child process for syn-rw-bench test.
+   Reads or rewrites its own file ROUND_CNT times, while the other
+   children do the same with theirs. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/filesys/base/syn-rw-bench.h"
+
+const char *test_name = "child-syn-rw";
+
+static char expected[FILE_SIZE];
+static char buf[FILE_SIZE];
+
+int
+main (int argc, const char *argv[]) 
+{
+  char file_name[16];
+  int child_idx;
+  int fd;
+  int round;
+
+  quiet = true;
+
+  CHECK (argc == 2, "argc must be 2, actually %d", argc);
+  child_idx = atoi (argv[1]);
+  snprintf (file_name, sizeof file_name, "data%d", child_idx);
+  memset (expected, 'a' + child_idx, sizeof expected);
+
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  for (round = 0; round < ROUND_CNT; round++)
+    {
+      seek (fd, 0);
+      if (IS_READER (child_idx))
+        {
+          CHECK (read (fd, buf, sizeof buf) == FILE_SIZE,
+                 "read \"%s\"", file_name);
+          compare_bytes (buf, expected, sizeof buf, 0, file_name);
+        }
+      else
+        CHECK (write (fd, expected, sizeof expected) == FILE_SIZE,
+               "write \"%s\"", file_name);
+    }
+  close (fd);
+
+  return child_idx;
+}
@@ -0,0 +1,74 @@
+/* Measures the cost of opening and closing a file while many
+   other files are open.  Finding out whether a file's inode is
+   already open should not depend on how many inodes are open, so
+   the cycles per open and close should stay flat as FILE_CNT
+   files are kept open. */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_CNT 100
+#define ROUND_CNT 20
+
+static int fds[FILE_CNT];
+
+/* Opens and closes each of the first FILE_CNT files ROUND_CNT
+   times while OPEN_CNT of them are held open, and reports the
+   average cycles per open and close. */
+static void
+measure (int open_cnt)
+{
+  uint64_t total = 0;
+  int i, round;
+
+  for (i = 0; i < open_cnt; i++)
+    {
+      char name[16];
+      snprintf (name, sizeof name, "file%d", i);
+      if ((fds[i] = open (name)) < 2)
+        fail ("open \"%s\" failed", name);
+    }
+
+  for (round = 0; round < ROUND_CNT; round++)
+    for (i = 0; i < FILE_CNT; i++)
+      {
+        char name[16];
+        uint64_t start;
+        int fd;
+
+        snprintf (name, sizeof name, "file%d", i);
+        start = rdtsc ();
+        fd = open (name);
+        close (fd);
+        total += rdtsc () - start;
+        if (fd < 2)
+          fail ("open \"%s\" failed", name);
+      }
+
+  for (i = 0; i < open_cnt; i++)
+    close (fds[i]);
+
+  msg ("%d files held open: %llu cycles per open and close", open_cnt,
+       (unsigned long long) (total / (ROUND_CNT * FILE_CNT)));
+}
+
+void
+test_main (void)
+{
+  int i;
+
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      char name[16];
+      snprintf (name, sizeof name, "file%d", i);
+      if (!create (name, 0))
+        fail ("create \"%s\" failed", name);
+    }
+  msg ("created %d files", FILE_CNT);
+
+  measure (0);
+  measure (FILE_CNT);
+}
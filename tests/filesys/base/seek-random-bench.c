@@ -0,0 +1,64 @@
+/* Measures the cost of reading one small block at a random
+   offset of a large file, separately for offsets near the start
+   and near the end of the file.  If finding the sector for an
+   offset meant walking the file's cluster chain from its first
+   cluster, reads near the end would cost far more than reads near
+   the start; with chain lookups cached, both should cost about
+   the same.  Also checks the data read back. */
+
+#include <random.h>
+#include <stdint.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define TEST_SIZE (200 * 1024)
+#define REGION_SIZE (8 * 1024)
+#define BLOCK_SIZE 64
+#define READ_CNT 256
+
+static char buf[TEST_SIZE];
+
+/* Reads READ_CNT blocks at random offsets within the REGION_SIZE
+   bytes starting at REGION from FD and reports the average
+   cycles per seek and read. */
+static void
+measure (int fd, const char *name, size_t region)
+{
+  uint64_t total = 0;
+  size_t i;
+
+  for (i = 0; i < READ_CNT; i++)
+    {
+      char block[BLOCK_SIZE];
+      size_t ofs = region + random_ulong () % (REGION_SIZE - BLOCK_SIZE);
+      uint64_t start = rdtsc ();
+
+      seek (fd, ofs);
+      if (read (fd, block, BLOCK_SIZE) != BLOCK_SIZE)
+        fail ("read %d bytes at offset %zu failed", BLOCK_SIZE, ofs);
+      total += rdtsc () - start;
+      compare_bytes (block, buf + ofs, BLOCK_SIZE, ofs, "bench");
+    }
+
+  msg ("%s of file: %llu cycles per read",
+       name, (unsigned long long) (total / READ_CNT));
+}
+
+void
+test_main (void)
+{
+  int fd;
+
+  random_init (0);
+  random_bytes (buf, sizeof buf);
+  CHECK (create ("bench", TEST_SIZE), "create \"bench\"");
+  CHECK ((fd = open ("bench")) > 1, "open \"bench\"");
+  CHECK (write (fd, buf, TEST_SIZE) == TEST_SIZE, "write \"bench\"");
+
+  /* Warm up, so that both measurements see a cached file. */
+  measure (fd, "warm-up", 0);
+  measure (fd, "start", 0);
+  measure (fd, "end", TEST_SIZE - REGION_SIZE);
+  close (fd);
+}
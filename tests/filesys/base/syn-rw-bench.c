@@ -0,0 +1,69 @@
+/* Spawns CHILD_CNT child processes, half of which read and half
+   of which rewrite a file of their own, and reports the aggregate
+   throughput.  Since the children use different files, none of
+   them should have to wait for another's transfer to finish.
+   Afterward, checks the contents of every file. */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+#include "tests/filesys/base/syn-rw-bench.h"
+
+static char buf[FILE_SIZE];
+static char expected[FILE_SIZE];
+
+void
+test_main (void) 
+{
+  pid_t children[CHILD_CNT];
+  uint64_t start, cycles;
+  unsigned long long bytes;
+  int i, fd;
+
+  for (i = 0; i < CHILD_CNT; i++)
+    {
+      char file_name[16];
+
+      snprintf (file_name, sizeof file_name, "data%d", i);
+      memset (buf, IS_READER (i) ? 'a' + i : 0, sizeof buf);
+      quiet = true;
+      CHECK (create (file_name, sizeof buf), "create \"%s\"", file_name);
+      CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+      CHECK (write (fd, buf, sizeof buf) == FILE_SIZE,
+             "write \"%s\"", file_name);
+      close (fd);
+      quiet = false;
+    }
+  msg ("created %d files", CHILD_CNT);
+
+  start = rdtsc ();
+  exec_children ("child-syn-rw", children, CHILD_CNT);
+  wait_children (children, CHILD_CNT);
+  cycles = rdtsc () - start;
+
+  bytes = (unsigned long long) CHILD_CNT * ROUND_CNT * FILE_SIZE;
+  msg ("%d readers and %d writers moved %llu bytes in %llu cycles",
+       CHILD_CNT / 2, CHILD_CNT - CHILD_CNT / 2, bytes,
+       (unsigned long long) cycles);
+  msg ("%llu bytes per 1000 cycles",
+       cycles > 0 ? bytes * 1000 / cycles : 0);
+
+  for (i = 0; i < CHILD_CNT; i++)
+    {
+      char file_name[16];
+
+      snprintf (file_name, sizeof file_name, "data%d", i);
+      memset (expected, 'a' + i, sizeof expected);
+      quiet = true;
+      CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+      CHECK (read (fd, buf, sizeof buf) == FILE_SIZE,
+             "read \"%s\"", file_name);
+      compare_bytes (buf, expected, sizeof buf, 0, file_name);
+      close (fd);
+      quiet = false;
+    }
+  msg ("verified %d files", CHILD_CNT);
+}
@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+
+common_checks ("run", @output);
+
+@output = get_core_output ("run", @output);
+fail "missing \"verified 8 files\" in output"
+  unless grep ($_ eq '(syn-rw-bench) verified 8 files', @output);
+fail "missing end in output"
+  unless grep ($_ eq '(syn-rw-bench) end', @output);
+
+pass;
@@ -0,0 +1,11 @@
+#ifndef TESTS_FILESYS_BASE_SYN_RW_BENCH_H
+#define TESTS_FILESYS_BASE_SYN_RW_BENCH_H
+
+#define CHILD_CNT 8
+#define FILE_SIZE 4096
+#define ROUND_CNT 16
+
+/* Even children read their file, odd children rewrite theirs. */
+#define IS_READER(CHILD_IDX) ((CHILD_IDX) % 2 == 0)
+
+#endif /* tests/filesys/base/syn-rw-bench.h */
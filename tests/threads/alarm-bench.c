@@ -0,0 +1,115 @@
+/* Measures the cost of the timer interrupt handler as the number
+   of sleeping threads grows.  For each round, creates N threads
+   that sleep until distinct ticks spread over a few seconds,
+   waits for all of them to wake up, and reports how many woke
+   and whether they woke in tick order, for the checker, and the
+   average number of TSC cycles spent per timer interrupt.  With a
+   timing wheel the figure should stay roughly flat as N grows. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+/* Ticks over which the wakeups of one round are spread. */
+#define SPREAD 300
+
+struct bench_sleeper
+  {
+    int64_t wake_tick;          /* Tick to sleep until. */
+    struct semaphore *done;     /* Upped after waking. */
+  };
+
+#define SLEEPER_MAX 256
+
+static struct bench_sleeper sleepers[SLEEPER_MAX];
+
+/* Indexes into SLEEPERS of the threads of a round, in the order
+   they woke up. */
+static int woken[SLEEPER_MAX];
+static int woken_cnt;
+
+static thread_func sleeper;
+static void run_round (int thread_cnt);
+
+void
+test_alarm_bench (void) 
+{
+  static const int counts[] = {0, 16, 64, 256};
+  size_t i;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  timer_intr_timing (true);
+  for (i = 0; i < sizeof counts / sizeof *counts; i++)
+    run_round (counts[i]);
+  timer_intr_timing (false);
+  pass ();
+}
+
+static void
+run_round (int thread_cnt) 
+{
+  struct semaphore done;
+  uint64_t cycles0, cnt0, cycles1, cnt1;
+  int64_t start;
+  int out_of_order;
+  int i;
+
+  ASSERT (thread_cnt <= SLEEPER_MAX);
+
+  sema_init (&done, 0);
+  woken_cnt = 0;
+  timer_sleep (1);
+  start = timer_ticks ();
+  timer_intr_stats (&cycles0, &cnt0);
+
+  for (i = 0; i < thread_cnt; i++) 
+    {
+      char name[16];
+      sleepers[i].wake_tick = start + 10 + (i * 37) % SPREAD;
+      sleepers[i].done = &done;
+      snprintf (name, sizeof name, "sleeper %d", i);
+      if (thread_create (name, PRI_DEFAULT, sleeper, &sleepers[i]) == TID_ERROR)
+        fail ("couldn't create thread %d", i);
+    }
+
+  if (thread_cnt == 0)
+    timer_sleep (10 + SPREAD);
+  for (i = 0; i < thread_cnt; i++)
+    sema_down (&done);
+
+  timer_intr_stats (&cycles1, &cnt1);
+
+  out_of_order = 0;
+  for (i = 1; i < woken_cnt; i++)
+    if (sleepers[woken[i]].wake_tick < sleepers[woken[i - 1]].wake_tick)
+      out_of_order++;
+  msg ("%d sleepers: %d woke, %d out of tick order", thread_cnt, woken_cnt,
+       out_of_order);
+  msg ("%d sleepers: %llu cycles per timer interrupt over %llu interrupts",
+       thread_cnt,
+       (unsigned long long) ((cycles1 - cycles0) / (cnt1 - cnt0 ? cnt1 - cnt0 : 1)),
+       (unsigned long long) (cnt1 - cnt0));
+}
+
+static void
+sleeper (void *sleeper_) 
+{
+  struct bench_sleeper *s = sleeper_;
+  enum intr_level old_level;
+
+  timer_sleep (s->wake_tick - timer_ticks ());
+  if (timer_ticks () < s->wake_tick)
+    fail ("thread woke up at tick %lld, before tick %lld",
+          (long long) timer_ticks (), (long long) s->wake_tick);
+
+  old_level = intr_disable ();
+  woken[woken_cnt++] = s - sleepers;
+  intr_set_level (old_level);
+  sema_up (s->done);
+}
@@ -0,0 +1,25 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+
+common_checks ("run", @output);
+
+@output = get_core_output ("run", @output);
+
+# Every sleeper of every round must have woken, in tick order.
+foreach my $cnt (0, 16, 64, 256) {
+    my ($line) = grep (/^\(alarm-bench\) $cnt sleepers: \d+ woke/, @output);
+    fail "missing round with $cnt sleepers in output" if !defined $line;
+    my ($woke, $bad) = $line =~ /: (\d+) woke, (\d+) out of tick order$/
+      or fail "malformed line: $line";
+    fail "only $woke of $cnt sleepers woke" if $woke != $cnt;
+    fail "$bad of $cnt sleepers woke out of tick order" if $bad != 0;
+}
+fail "missing PASS in output"
+  unless grep ($_ eq '(alarm-bench) PASS', @output);
+
+pass;
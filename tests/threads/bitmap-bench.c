@@ -0,0 +1,107 @@
+/* Measures the cost of finding free pages in a nearly full
+   bitmap the size of a 16 MiB page pool.  Only a scattering of
+   single pages and one run of 8 pages near the end are free.
+   For several request sizes, reports the TSC cycles taken by
+   bitmap_scan() and by the old bit-by-bit search, which tried
+   every starting bit in turn, and where each found the pages.
+   Also reports the free runs bitmap_scan_run() walks.  The
+   checker knows where the free pages are. */
+
+#include <bitmap.h>
+#include <intrinsic.h>
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/vaddr.h"
+
+/* Pages in the pool. */
+#define POOL_PAGES (16 * 1024 * 1024 / PGSIZE)
+
+/* One page in this many is left free. */
+#define FREE_STRIDE 97
+
+/* Start and length of the only run of free pages. */
+#define RUN_START (POOL_PAGES - 100)
+#define RUN_LEN 8
+
+static void bench_scan (const struct bitmap *, size_t cnt);
+static size_t slow_scan (const struct bitmap *, size_t cnt);
+
+void
+test_bitmap_bench (void) 
+{
+  struct bitmap *pool = bitmap_create (POOL_PAGES);
+  size_t start, cnt, free_cnt, run_cnt;
+  size_t i;
+
+  if (pool == NULL)
+    fail ("couldn't create a bitmap of %d bits", POOL_PAGES);
+  bitmap_set_all (pool, true);
+  for (i = FREE_STRIDE / 2; i < POOL_PAGES; i += FREE_STRIDE)
+    bitmap_reset (pool, i);
+  bitmap_set_multiple (pool, RUN_START, RUN_LEN, false);
+
+  bench_scan (pool, 1);
+  bench_scan (pool, 2);
+  bench_scan (pool, RUN_LEN);
+  bench_scan (pool, RUN_LEN + 1);
+
+  free_cnt = run_cnt = 0;
+  for (start = 0; (start = bitmap_scan_run (pool, start, false, &cnt))
+         != BITMAP_ERROR; start += cnt)
+    {
+      if (cnt == 0 || bitmap_contains (pool, start, cnt, true))
+        fail ("run of %zu bits at %zu is not free", cnt, start);
+      if (start + cnt < POOL_PAGES && !bitmap_test (pool, start + cnt))
+        fail ("run at %zu stops short at %zu bits", start, cnt);
+      free_cnt += cnt;
+      run_cnt++;
+    }
+  msg ("%zu free runs cover %zu of %zu free pages", run_cnt, free_cnt,
+       bitmap_count (pool, 0, POOL_PAGES, false));
+
+  bitmap_destroy (pool);
+  pass ();
+}
+
+/* Finds CNT free pages in POOL both ways and reports where each
+   found them, or -1 if neither did, and the cycles each took. */
+static void
+bench_scan (const struct bitmap *pool, size_t cnt) 
+{
+  uint64_t start, fast_cycles, slow_cycles;
+  size_t fast, slow;
+
+  start = rdtsc ();
+  fast = bitmap_scan (pool, 0, cnt, false);
+  fast_cycles = rdtsc () - start;
+
+  start = rdtsc ();
+  slow = slow_scan (pool, cnt);
+  slow_cycles = rdtsc () - start;
+
+  msg ("%zu pages: word scan found %lld, bit scan found %lld", cnt,
+       fast == BITMAP_ERROR ? -1 : (long long) fast,
+       slow == BITMAP_ERROR ? -1 : (long long) slow);
+  msg ("%zu pages: %llu cycles by word scan, %llu cycles by bit scan",
+       cnt, (unsigned long long) fast_cycles,
+       (unsigned long long) slow_cycles);
+}
+
+/* Finds CNT free pages in POOL by testing every starting bit one
+   bit at a time, as bitmap_scan() used to. */
+static size_t
+slow_scan (const struct bitmap *pool, size_t cnt) 
+{
+  size_t size = bitmap_size (pool);
+  size_t i, j;
+
+  for (i = 0; i + cnt <= size; i++)
+    {
+      for (j = 0; j < cnt; j++)
+        if (bitmap_test (pool, i + j))
+          break;
+      if (j == cnt)
+        return i;
+    }
+  return BITMAP_ERROR;
+}
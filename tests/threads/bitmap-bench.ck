@@ -0,0 +1,27 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+
+common_checks ("run", @output);
+
+@output = get_core_output ("run", @output);
+
+# Every 97th page starting at 48 is free, plus pages 3996...4003.
+my (%expected) = (1 => 48, 2 => 3996, 8 => 3996, 9 => -1);
+foreach my $cnt (sort { $a <=> $b } keys %expected) {
+    my ($where) = $expected{$cnt};
+    fail "scans for $cnt pages did not both find $where"
+      unless grep ($_ eq "(bitmap-bench) $cnt pages: word scan found "
+		   . "$where, bit scan found $where", @output);
+}
+fail "free runs were not walked exactly"
+  unless grep ($_ eq '(bitmap-bench) 43 free runs cover 50 of 50 free pages',
+	       @output);
+fail "missing PASS in output"
+  unless grep ($_ eq '(bitmap-bench) PASS', @output);
+
+pass;
@@ -0,0 +1,48 @@
+/* Overwrites the middle of a copy of "sample.txt" with pwrite()
+   and reads it back with pread(), checking that neither call
+   moves the file position. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define OFS 50
+#define LEN 20
+
+void
+test_main (void)
+{
+  char expected[sizeof sample];
+  char buf[LEN];
+  size_t size = sizeof sample - 1;
+  int handle;
+
+  CHECK (create ("test.txt", 0), "create \"test.txt\"");
+  CHECK ((handle = open ("test.txt")) > 1, "open \"test.txt\"");
+  if (write (handle, sample, size) != (int) size)
+    fail ("write \"test.txt\" failed");
+  seek (handle, 5);
+
+  memcpy (expected, sample, size);
+  memset (expected + OFS, 'x', LEN);
+  memset (buf, 'x', LEN);
+  if (pwrite (handle, buf, LEN, OFS) != LEN)
+    fail ("pwrite \"test.txt\" failed");
+  if (tell (handle) != 5)
+    fail ("pwrite() moved the file position to %u", tell (handle));
+
+  memset (buf, 0, LEN);
+  if (pread (handle, buf, LEN, OFS - 5) != LEN)
+    fail ("pread \"test.txt\" failed");
+  compare_bytes (buf, expected + OFS - 5, LEN, OFS - 5, "test.txt");
+  if (tell (handle) != 5)
+    fail ("pread() moved the file position to %u", tell (handle));
+  if (pread (handle, buf, LEN, size) != 0)
+    fail ("pread() past end of file read something");
+  msg ("close \"test.txt\"");
+  close (handle);
+
+  check_file ("test.txt", expected, size);
+}
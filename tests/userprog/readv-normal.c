@@ -0,0 +1,40 @@
+/* Reads "sample.txt" with one readv() into three buffers of
+   uneven sizes and checks that they hold the file in order. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void)
+{
+  char head[7], middle[100], tail[sizeof sample];
+  struct iovec iov[3];
+  size_t size = sizeof sample - 1;
+  int handle, byte_cnt;
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+
+  iov[0].iov_base = head;
+  iov[0].iov_len = sizeof head;
+  iov[1].iov_base = middle;
+  iov[1].iov_len = sizeof middle;
+  iov[2].iov_base = tail;
+  iov[2].iov_len = sizeof tail;
+  byte_cnt = readv (handle, iov, 3);
+  if (byte_cnt != (int) size)
+    fail ("readv() returned %d instead of %zu", byte_cnt, size);
+
+  compare_bytes (head, sample, sizeof head, 0, "sample.txt");
+  compare_bytes (middle, sample + sizeof head, sizeof middle,
+                 sizeof head, "sample.txt");
+  compare_bytes (tail, sample + sizeof head + sizeof middle,
+                 size - sizeof head - sizeof middle,
+                 sizeof head + sizeof middle, "sample.txt");
+  msg ("verified contents of \"sample.txt\"");
+
+  if (tell (handle) != size)
+    fail ("tell() returned %u instead of %zu", tell (handle), size);
+}
@@ -0,0 +1,211 @@
+/* Times memcpy(), memmove(), memset() and memcmp() from the C
+   library against plain byte-at-a-time loops on page-sized
+   buffers.  Reports in how many rounds both produced the same
+   result, which the checker requires to be all of them, and the
+   cycles taken by each. */
+
+#include <stdint.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define BUF_SIZE 4096
+#define ROUNDS 256
+
+static char src[BUF_SIZE + 16] __attribute__ ((aligned (4096)));
+static char dst[BUF_SIZE + 16] __attribute__ ((aligned (4096)));
+static char ref[BUF_SIZE + 16] __attribute__ ((aligned (4096)));
+
+static void *
+byte_memcpy (void *dst_, const void *src_, size_t size)
+{
+  unsigned char *d = dst_;
+  const unsigned char *s = src_;
+
+  while (size-- > 0)
+    *d++ = *s++;
+  return dst_;
+}
+
+static void *
+byte_memmove (void *dst_, const void *src_, size_t size)
+{
+  unsigned char *d = dst_;
+  const unsigned char *s = src_;
+
+  if (d < s)
+    while (size-- > 0)
+      *d++ = *s++;
+  else
+    {
+      d += size;
+      s += size;
+      while (size-- > 0)
+        *--d = *--s;
+    }
+  return dst_;
+}
+
+static void *
+byte_memset (void *dst_, int value, size_t size)
+{
+  unsigned char *d = dst_;
+
+  while (size-- > 0)
+    *d++ = value;
+  return dst_;
+}
+
+static int
+byte_memcmp (const void *a_, const void *b_, size_t size)
+{
+  const unsigned char *a = a_;
+  const unsigned char *b = b_;
+
+  for (; size-- > 0; a++, b++)
+    if (*a != *b)
+      return *a > *b ? 1 : -1;
+  return 0;
+}
+
+/* Fills SRC with a pattern that depends on SEED. */
+static void
+fill_src (int seed)
+{
+  size_t i;
+
+  for (i = 0; i < sizeof src; i++)
+    src[i] = (char) (i * 31 + seed);
+}
+
+/* Reports how many rounds of the operation named WHAT gave the
+   same result from the byte loop and the library, and the cycles
+   each took. */
+static void
+report (const char *what, int agree, uint64_t loop, uint64_t lib)
+{
+  msg ("%s: %d of %d rounds agree", what, agree, ROUNDS);
+  msg ("%s: %llu cycles by byte loop, %llu cycles by library", what,
+       (unsigned long long) loop, (unsigned long long) lib);
+}
+
+/* Copies SRC + SKEW to DST with both memcpy()s. */
+static void
+bench_memcpy (size_t skew)
+{
+  uint64_t loop = 0, lib = 0, start;
+  int agree = 0;
+  int i;
+
+  for (i = 0; i < ROUNDS; i++)
+    {
+      fill_src (i);
+      start = rdtsc ();
+      byte_memcpy (ref, src + skew, BUF_SIZE);
+      loop += rdtsc () - start;
+      start = rdtsc ();
+      memcpy (dst, src + skew, BUF_SIZE);
+      lib += rdtsc () - start;
+      if (!byte_memcmp (dst, ref, BUF_SIZE))
+        agree++;
+    }
+  report (skew ? "memcpy (unaligned)" : "memcpy (aligned)", agree,
+          loop, lib);
+}
+
+/* Moves an overlapping block up and back down by 3 bytes with
+   both memmove()s. */
+static void
+bench_memmove (void)
+{
+  uint64_t loop = 0, lib = 0, start;
+  int agree = 0;
+  int i;
+
+  for (i = 0; i < ROUNDS; i++)
+    {
+      bool same;
+
+      fill_src (i);
+      byte_memcpy (ref, src, sizeof ref);
+      byte_memcpy (dst, src, sizeof dst);
+      start = rdtsc ();
+      byte_memmove (ref + 3, ref, BUF_SIZE);
+      loop += rdtsc () - start;
+      start = rdtsc ();
+      memmove (dst + 3, dst, BUF_SIZE);
+      lib += rdtsc () - start;
+      same = !byte_memcmp (dst, ref, sizeof dst);
+
+      start = rdtsc ();
+      byte_memmove (ref, ref + 3, BUF_SIZE);
+      loop += rdtsc () - start;
+      start = rdtsc ();
+      memmove (dst, dst + 3, BUF_SIZE);
+      lib += rdtsc () - start;
+      if (same && !byte_memcmp (dst, ref, sizeof dst))
+        agree++;
+    }
+  report ("memmove", agree, loop, lib);
+}
+
+/* Fills DST + 1 with both memset()s. */
+static void
+bench_memset (void)
+{
+  uint64_t loop = 0, lib = 0, start;
+  int agree = 0;
+  int i;
+
+  for (i = 0; i < ROUNDS; i++)
+    {
+      start = rdtsc ();
+      byte_memset (ref + 1, i, BUF_SIZE);
+      loop += rdtsc () - start;
+      start = rdtsc ();
+      memset (dst + 1, i, BUF_SIZE);
+      lib += rdtsc () - start;
+      if (!byte_memcmp (dst + 1, ref + 1, BUF_SIZE))
+        agree++;
+    }
+  report ("memset", agree, loop, lib);
+}
+
+/* Compares buffers that differ only in their last byte with both
+   memcmp()s. */
+static void
+bench_memcmp (void)
+{
+  uint64_t loop = 0, lib = 0, start;
+  int agree = 0;
+  int i;
+
+  fill_src (0);
+  byte_memcpy (dst, src, BUF_SIZE);
+  dst[BUF_SIZE - 1]++;
+  for (i = 0; i < ROUNDS; i++)
+    {
+      int expected, actual;
+
+      start = rdtsc ();
+      expected = byte_memcmp (src, dst, BUF_SIZE);
+      loop += rdtsc () - start;
+      start = rdtsc ();
+      actual = memcmp (src, dst, BUF_SIZE);
+      lib += rdtsc () - start;
+      if (expected == actual)
+        agree++;
+    }
+  report ("memcmp", agree, loop, lib);
+}
+
+void
+test_main (void)
+{
+  bench_memcpy (0);
+  bench_memcpy (5);
+  bench_memmove ();
+  bench_memset ();
+  bench_memcmp ();
+}
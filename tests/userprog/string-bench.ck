@@ -0,0 +1,21 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+
+common_checks ("run", @output);
+
+@output = get_core_output ("run", @output);
+foreach my $op ('memcpy (aligned)', 'memcpy (unaligned)', 'memmove',
+		'memset', 'memcmp') {
+    fail "$op disagrees with the byte loop"
+      unless grep ($_ eq "(string-bench) $op: 256 of 256 rounds agree",
+		   @output);
+}
+fail "missing end in output"
+  unless grep ($_ eq '(string-bench) end', @output);
+
+pass;
@@ -0,0 +1,32 @@
+/* Writes "sample.txt" into a new file from three buffers with one
+   writev() and reads the file back. */
+
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void)
+{
+  struct iovec iov[3];
+  size_t size = sizeof sample - 1;
+  int handle, byte_cnt;
+
+  CHECK (create ("test.txt", 0), "create \"test.txt\"");
+  CHECK ((handle = open ("test.txt")) > 1, "open \"test.txt\"");
+
+  iov[0].iov_base = sample;
+  iov[0].iov_len = 10;
+  iov[1].iov_base = sample + 10;
+  iov[1].iov_len = 0;
+  iov[2].iov_base = sample + 10;
+  iov[2].iov_len = size - 10;
+  byte_cnt = writev (handle, iov, 3);
+  if (byte_cnt != (int) size)
+    fail ("writev() returned %d instead of %zu", byte_cnt, size);
+  msg ("close \"test.txt\"");
+  close (handle);
+
+  check_file ("test.txt", sample, size);
+}
@@ -0,0 +1,55 @@
+/* Measures fork latency for a process with a large resident
+   address space.  With copy-on-write, fork shares the parent's
+   frames instead of copying them, so the time until fork returns
+   in the parent should barely depend on how much memory the
+   parent has touched.  Also checks that the child sees the
+   parent's data. */
+
+#include <stdint.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define FORK_CNT 8
+
+static char buf[256 * PAGE_SIZE];
+
+/* Touches the first PAGE_CNT pages of BUF, then forks FORK_CNT
+   children and reports the average cycles for fork to return. */
+static void
+measure (size_t page_cnt)
+{
+  uint64_t total = 0;
+  size_t i;
+
+  for (i = 0; i < page_cnt; i++)
+    buf[i * PAGE_SIZE] = i;
+
+  for (i = 0; i < FORK_CNT; i++)
+    {
+      uint64_t start = rdtsc ();
+      pid_t pid = fork ("child");
+
+      if (pid == 0)
+        exit (page_cnt == 0 || buf[(page_cnt - 1) * PAGE_SIZE] == (char) (page_cnt - 1)
+              ? 0 : 1);
+      total += rdtsc () - start;
+
+      if (pid < 0)
+        fail ("fork #%zu failed", i);
+      if (wait (pid) != 0)
+        fail ("child #%zu saw wrong data", i);
+    }
+
+  msg ("%zu resident pages: %llu cycles per fork",
+       page_cnt, (unsigned long long) (total / FORK_CNT));
+}
+
+void
+test_main (void)
+{
+  measure (0);
+  measure (64);
+  measure (256);
+}
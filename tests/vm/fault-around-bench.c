@@ -0,0 +1,63 @@
+/* Maps large.txt and touches every page of it twice: first in
+   order, then in a scattered order, reporting how many page
+   faults had to load a page from the file each time.  With
+   read-ahead the sequential pass loads most pages before they are
+   touched, so it should take far fewer such faults than pages,
+   while the scattered pass, where read-ahead backs off, should
+   take about one per page.  Also checks the mapped data against
+   read(). */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+
+/* Touches the PAGE_CNT pages at MAP in the order given by STRIDE
+   (which must be coprime with PAGE_CNT) and reports the faults. */
+static void
+touch_pages (const char *name, int handle, const char *map,
+             size_t page_cnt, size_t stride)
+{
+  long long faults = get_page_fault_cnt ();
+  long long major = get_major_fault_cnt ();
+  char buf[16];
+  size_t i, page;
+
+  for (i = 0, page = 0; i < page_cnt; i++, page = (page + stride) % page_cnt)
+    {
+      seek (handle, page * PAGE_SIZE);
+      read (handle, buf, sizeof buf);
+      if (memcmp (buf, map + page * PAGE_SIZE, sizeof buf))
+        fail ("%s: page %zu of mmap'd file has bad data", name, page);
+    }
+
+  msg ("%s: %zu pages, %lld faults, %lld loaded from file",
+       name, page_cnt, get_page_fault_cnt () - faults,
+       get_major_fault_cnt () - major);
+}
+
+void
+test_main (void)
+{
+  char *actual = (char *) 0x10000000;
+  int handle;
+  size_t page_cnt;
+  void *map;
+
+  CHECK ((handle = open ("large.txt")) > 1, "open \"large.txt\"");
+  page_cnt = filesize (handle) / PAGE_SIZE;
+
+  CHECK ((map = mmap (actual, page_cnt * PAGE_SIZE, 0, handle, 0))
+         != MAP_FAILED, "mmap \"large.txt\"");
+  touch_pages ("sequential", handle, actual, page_cnt, 1);
+  munmap (map);
+
+  CHECK ((map = mmap (actual, page_cnt * PAGE_SIZE, 0, handle, 0))
+         != MAP_FAILED, "mmap \"large.txt\" again");
+  touch_pages ("scattered", handle, actual, page_cnt, 97);
+  munmap (map);
+
+  close (handle);
+}
@@ -0,0 +1,35 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+
+common_checks ("run", @output);
+
+@output = get_core_output ("run", @output);
+
+# Returns the page count and the number of pages loaded from the
+# file for the pass named $name.
+sub pass_loads {
+    my ($name) = @_;
+    foreach (@output) {
+	return ($1, $2)
+	  if /^\(fault-around-bench\) $name: (\d+) pages, \d+ faults, (\d+) loaded from file$/;
+    }
+    fail "missing $name pass in output";
+}
+
+my ($seq_pages, $seq_loads) = pass_loads ('sequential');
+my ($sca_pages, $sca_loads) = pass_loads ('scattered');
+fail "sequential pass loaded $seq_loads of $seq_pages pages on fault, "
+  . "read-ahead should have loaded most of them"
+  unless $seq_loads * 2 < $seq_pages;
+fail "scattered pass loaded only $sca_loads of $sca_pages pages on fault, "
+  . "read-ahead should have backed off"
+  unless $sca_loads * 2 > $sca_pages;
+fail "missing end in output"
+  unless grep ($_ eq '(fault-around-bench) end', @output);
+
+pass;
@@ -36,6 +36,7 @@
 #include "devices/disk.h"
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
+#include "filesys/page_cache.h"
 #endif
 
 /* Page-map-level-4 with kernel mappings only. */
@@ -216,6 +217,8 @@ parse_options (char **argv) {
 #ifdef FILESYS
 		else if (!strcmp (name, "-f"))
 			format_filesys = true;
+		else if (!strcmp (name, "-dma"))
+			disk_use_dma = true;
 #endif
 		else if (!strcmp (name, "-rs"))
 			random_init (atoi (value));
@@ -226,6 +229,14 @@ parse_options (char **argv) {
 			user_page_limit = atoi (value);
 		else if (!strcmp (name, "-threads-tests"))
 			thread_tests = true;
+#endif
+#ifdef VM
+		else if (!strcmp (name, "-kswapd-low"))
+			kswapd_low = atoi (value);
+		else if (!strcmp (name, "-kswapd-high"))
+			kswapd_high = atoi (value);
+		else if (!strcmp (name, "-kswapd-zero"))
+			kswapd_zero = atoi (value);
 #endif
 		else
 			PANIC ("unknown option `%s' (use -h for help)", name);
@@ -324,10 +335,17 @@ usage (void) {
 			"  -h                 Print this help message and power off.\n"
 			"  -q                 Power off VM after actions or on panic.\n"
 			"  -f                 Format file system disk during startup.\n"
+			"  -dma               Use bus master DMA for disk transfers.\n"
 			"  -rs=SEED           Set random number seed to SEED.\n"
 			"  -mlfqs             Use multi-level feedback queue scheduler.\n"
 #ifdef USERPROG
 			"  -ul=COUNT          Limit user memory to COUNT pages.\n"
+#endif
+#ifdef VM
+			"  -kswapd-low=PAGES  Start background reclaim below PAGES free frames.\n"
+			"                     0 disables the reclaim daemon.\n"
+			"  -kswapd-high=PAGES Stop background reclaim at PAGES free frames.\n"
+			"  -kswapd-zero=PAGES Keep up to PAGES free frames pre-zeroed.\n"
 #endif
 			);
 	power_off ();
@@ -356,6 +374,8 @@ print_stats (void) {
 	thread_print_stats ();
 #ifdef FILESYS
 	disk_print_stats ();
+	disk_print_sched_stats ();
+	page_cache_print_stats ();
 #endif
 	console_print_stats ();
 	kbd_print_stats ();
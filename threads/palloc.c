@@ -275,7 +275,8 @@ palloc_get_multiple (enum palloc_flags flags, size_t page_cnt) {
 
 	if (pages) {
 		if (flags & PAL_ZERO)
-			memset (pages, 0, PGSIZE * page_cnt);
+			for (size_t i = 0; i < page_cnt; i++)
+				page_zero (pages + PGSIZE * i);
 	} else {
 		if (flags & PAL_ASSERT)
 			PANIC ("palloc_get: out of pages");
@@ -328,6 +329,27 @@ palloc_free_page (void *page) {
 	palloc_free_multiple (page, 1);
 }
 
+/* Returns the number of pages currently free in the user pool. */
+size_t
+palloc_user_free_cnt (void) {
+	size_t cnt;
+
+	lock_acquire (&user_pool.lock);
+	cnt = bitmap_count (user_pool.used_map, 0,
+			bitmap_size (user_pool.used_map), false);
+	lock_release (&user_pool.lock);
+	return cnt;
+}
+
+/* Stores the number of pages in the user pool into *PAGE_CNT and
+   returns the kernel virtual address of its first page.  Every page
+   handed out with PAL_USER lies in [base, base + *PAGE_CNT * PGSIZE). */
+void *
+palloc_user_pool_range (size_t *page_cnt) {
+	*page_cnt = bitmap_size (user_pool.used_map);
+	return user_pool.base;
+}
+
 /* Initializes pool P as starting at START and ending at END */
 static void
 init_pool (struct pool *p, void **bm_base, uint64_t start, uint64_t end) {
@@ -356,3 +378,26 @@ page_from_pool (const struct pool *pool, void *page) {
 	size_t end_page = start_page + bitmap_size (pool->used_map);
 	return page_no >= start_page && page_no < end_page;
 }
+
+/* Copies the page at SRC to the page at DST.  Both must be
+   page-aligned.  Unlike memcpy(), there is no head or tail to
+   handle, so this is a single "rep movsq" of PGSIZE / 8 words. */
+void
+page_copy (void *dst, const void *src) {
+	size_t cnt = PGSIZE / sizeof (uint64_t);
+
+	ASSERT (pg_ofs (dst) == 0 && pg_ofs (src) == 0);
+	asm volatile ("rep movsq"
+			: "+D" (dst), "+S" (src), "+c" (cnt) : : "memory");
+}
+
+/* Fills the page at PAGE, which must be page-aligned, with
+   zeros. */
+void
+page_zero (void *page) {
+	size_t cnt = PGSIZE / sizeof (uint64_t);
+
+	ASSERT (pg_ofs (page) == 0);
+	asm volatile ("rep stosq"
+			: "+D" (page), "+c" (cnt) : "a" (0) : "memory");
+}
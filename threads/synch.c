@@ -224,7 +224,7 @@ lock_acquire (struct lock *lock) {
 	ASSERT (!intr_context ());
 	ASSERT (!lock_held_by_current_thread (lock));
   
-  if (lock->holder != NULL) {
+  if (!thread_mlfqs && lock->holder != NULL) {
     struct thread *cur = thread_current();
     cur->wait_on_lock = lock;
     list_push_back(&lock->holder->donations, &cur->donation_elem);
@@ -268,8 +268,10 @@ lock_release (struct lock *lock) {
 
 	lock->holder = NULL;
 
-  remove_with_lock(lock);
-  refresh_priority();
+  if (!thread_mlfqs) {
+    remove_with_lock(lock);
+    refresh_priority();
+  }
 
 	sema_up (&lock->semaphore);
 }
@@ -369,3 +371,60 @@ cond_broadcast (struct condition *cond, struct lock *lock) {
 	while (!list_empty (&cond->waiters))
 		cond_signal (cond, lock);
 }
+
+/* Initializes RW, a readers-writer lock.  Any number of readers
+   may hold RW at once, or else a single writer.
+
+   Readers only wait while a writer actually holds RW, never for a
+   writer that is merely waiting, so a thread that already holds
+   RW for reading may acquire it for reading again.  Writers may
+   therefore be starved by a steady stream of readers. */
+void
+rwlock_init (struct rwlock *rw) {
+	ASSERT (rw != NULL);
+
+	lock_init (&rw->lock);
+	cond_init (&rw->changed);
+	rw->readers = 0;
+	rw->writer = false;
+}
+
+/* Acquires RW for reading, sleeping until no writer holds it. */
+void
+rwlock_acquire_read (struct rwlock *rw) {
+	lock_acquire (&rw->lock);
+	while (rw->writer)
+		cond_wait (&rw->changed, &rw->lock);
+	rw->readers++;
+	lock_release (&rw->lock);
+}
+
+/* Releases RW, which the current thread holds for reading. */
+void
+rwlock_release_read (struct rwlock *rw) {
+	lock_acquire (&rw->lock);
+	ASSERT (rw->readers > 0);
+	if (--rw->readers == 0)
+		cond_broadcast (&rw->changed, &rw->lock);
+	lock_release (&rw->lock);
+}
+
+/* Acquires RW for writing, sleeping until nobody holds it. */
+void
+rwlock_acquire_write (struct rwlock *rw) {
+	lock_acquire (&rw->lock);
+	while (rw->writer || rw->readers > 0)
+		cond_wait (&rw->changed, &rw->lock);
+	rw->writer = true;
+	lock_release (&rw->lock);
+}
+
+/* Releases RW, which the current thread holds for writing. */
+void
+rwlock_release_write (struct rwlock *rw) {
+	lock_acquire (&rw->lock);
+	ASSERT (rw->writer);
+	rw->writer = false;
+	cond_broadcast (&rw->changed, &rw->lock);
+	lock_release (&rw->lock);
+}
@@ -11,6 +11,7 @@
 #include "threads/synch.h"
 #include "threads/vaddr.h"
 #include "intrinsic.h"
+#include "devices/timer.h"
 // * 추가
 #include "threads/malloc.h"
 #ifdef USERPROG
@@ -30,12 +31,35 @@
    Do not modify this value. */
 #define THREAD_BASIC 0xd42df210
 
-/* List of processes in THREAD_READY state, that is, processes
-   that are ready to run but not actually running. */
-static struct list ready_list;
-
-static struct list sleep_list;
-static int64_t next_tick_to_awake = INT64_MAX;
+/* Processes in THREAD_READY state, that is, processes that are
+   ready to run but not actually running.  There is one FIFO queue
+   per priority level, and bit N of ready_bitmap is set iff
+   ready_queues[N] is non-empty, so the highest runnable priority
+   is a single bit scan. */
+#define PRI_CNT (PRI_MAX - PRI_MIN + 1)
+static struct list ready_queues[PRI_CNT];
+static uint64_t ready_bitmap;
+static size_t ready_cnt;        /* # of threads in ready_queues. */
+
+/* List of all processes.  Processes are added to this list when
+   they are created and removed when they exit.  Only the MLFQS
+   walks it, once per second. */
+static struct list all_list;
+
+/* Sleeping threads, kept in a hierarchical timing wheel.  Level L
+   holds threads whose wakeup tick is less than 256^(L+1) ticks
+   past wheel_tick, hashed into a slot by the corresponding byte of
+   the wakeup tick.  Each tick only the current level-0 slot is
+   drained; every 256 ticks the matching slot of the next level is
+   cascaded down, so both sleeping and waking are O(1) in the
+   number of sleepers. */
+#define WHEEL_BITS 8
+#define WHEEL_SIZE (1 << WHEEL_BITS)
+#define WHEEL_MASK (WHEEL_SIZE - 1)
+#define WHEEL_LEVELS 4
+static struct list sleep_wheel[WHEEL_LEVELS][WHEEL_SIZE];
+static int64_t wheel_tick;      /* Last tick processed by the wheel. */
+static size_t sleeper_cnt;      /* # of threads in the wheel. */
 
 /* Idle thread. */
 static struct thread *idle_thread;
@@ -63,6 +87,9 @@ static unsigned thread_ticks;   /* # of timer ticks since last yield. */
    Controlled by kernel command-line option "-o mlfqs". */
 bool thread_mlfqs;
 
+/* System load average, for the MLFQS. */
+static fixed_t load_avg;
+
 static void kernel_thread (thread_func *, void *aux);
 
 static void idle (void *aux UNUSED);
@@ -71,6 +98,13 @@ static void init_thread (struct thread *, const char *name, int priority, int wa
 static void do_schedule(int status);
 static void schedule (void);
 static tid_t allocate_tid (void);
+static void ready_queue_push (struct thread *);
+static void ready_queue_remove (struct thread *);
+static int ready_max_priority (void);
+static void wheel_insert (struct thread *, int64_t earliest);
+static void wheel_cascade (int level);
+static int mlfqs_priority (struct thread *);
+static void mlfqs_recalc_all (void);
 
 /* Returns true if T appears to point to a valid thread. */
 #define is_thread(t) ((t) != NULL && (t)->magic == THREAD_MAGIC)
@@ -116,8 +150,13 @@ thread_init (void) {
 
 	/* Init the globla thread context */
 	lock_init (&tid_lock);
-	list_init (&ready_list);
-	list_init (&sleep_list);
+	for (int i = 0; i < PRI_CNT; i++)
+		list_init (&ready_queues[i]);
+	ready_bitmap = 0;
+	list_init (&all_list);
+	for (int i = 0; i < WHEEL_LEVELS; i++)
+		for (int j = 0; j < WHEEL_SIZE; j++)
+			list_init (&sleep_wheel[i][j]);
 	list_init (&destruction_req);
 
 	/* Set up a thread structure for the running thread. */
@@ -159,6 +198,22 @@ thread_tick (void) {
 	else
 		kernel_ticks++;
 
+	/* Only the running thread's recent_cpu changes between the once
+	   per second recalculations, so only its priority can change on
+	   the intervening 4th ticks. */
+	if (thread_mlfqs) {
+		int64_t now = timer_ticks ();
+
+		if (t != idle_thread)
+			t->recent_cpu = fp_add_int (t->recent_cpu, 1);
+		if (now % TIMER_FREQ == 0) {
+			mlfqs_recalc_all ();
+			if (preempt_by_priority ())
+				intr_yield_on_return ();
+		} else if (now % TIME_SLICE == 0 && t != idle_thread)
+			t->priority = mlfqs_priority (t);
+	}
+
 	/* Enforce preemption. */
 	if (++thread_ticks >= TIME_SLICE)
 		intr_yield_on_return ();
@@ -202,6 +257,11 @@ thread_create (const char *name, int priority,
 	/* Initialize thread. */
 	init_thread (t, name, priority, 0);
 	tid = t->tid = allocate_tid ();
+	if (thread_mlfqs) {
+		t->nice = thread_current ()->nice;
+		t->recent_cpu = thread_current ()->recent_cpu;
+		t->priority = t->init_priority = mlfqs_priority (t);
+	}
 
 	/* Call the kernel_thread if it scheduled.
 	 * Note) rdi is 1st argument, and rsi is 2nd argument. */
@@ -226,6 +286,11 @@ thread_create (const char *name, int priority,
   // t->fdt = (struct file **)calloc(128, sizeof(struct file *));
   t->fdt = palloc_get_page(PAL_ZERO);
 	if (t->fdt == NULL) {
+		enum intr_level old_level = intr_disable ();
+		list_remove (&t->child_elem);
+		list_remove (&t->all_elem);
+		intr_set_level (old_level);
+		palloc_free_page (t);
 		return TID_ERROR;
 	}
   t->fdt[0] = 1;
@@ -257,26 +322,69 @@ cmp_priority (const struct list_elem *a, const struct list_elem *b, void *aux UN
 void test_max_priority (void) {
 
   // * 추가 코드
-  if (!list_empty(&ready_list)) {
-    if (cmp_priority(list_begin(&ready_list), &thread_current()->elem, NULL)) {
-      thread_yield();
-    }
-  }
+  if (ready_max_priority () > thread_get_priority ())
+    thread_yield ();
 
 }
 
 bool preempt_by_priority(void)
 {
-  int curr_priority;
-  struct thread *max_ready_thread;
-  struct list_elem *max_ready_elem;
-  curr_priority = thread_get_priority();
-  if (list_empty(&ready_list))
-    return false; /* !! if ready list is empty, return false directly !!*/
-  list_sort(&ready_list, &cmp_priority, NULL);
-  max_ready_elem = list_begin(&ready_list);
-  max_ready_thread = list_entry(max_ready_elem, struct thread, elem);
-  return curr_priority < max_ready_thread->priority;
+  return thread_get_priority () < ready_max_priority ();
+}
+
+/* Appends T to the tail of the ready queue for its priority and
+   marks that level as occupied.  Interrupts must be off. */
+static void
+ready_queue_push (struct thread *t) {
+	ASSERT (intr_get_level () == INTR_OFF);
+	ASSERT (PRI_MIN <= t->priority && t->priority <= PRI_MAX);
+
+	list_push_back (&ready_queues[t->priority - PRI_MIN], &t->elem);
+	ready_bitmap |= 1ULL << (t->priority - PRI_MIN);
+	ready_cnt++;
+}
+
+/* Removes T from the ready queue for its priority, clearing the
+   level's bit if the queue became empty.  Interrupts must be off. */
+static void
+ready_queue_remove (struct thread *t) {
+	int idx = t->priority - PRI_MIN;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	list_remove (&t->elem);
+	if (list_empty (&ready_queues[idx]))
+		ready_bitmap &= ~(1ULL << idx);
+	ready_cnt--;
+}
+
+/* Returns the highest priority among ready threads, or
+   PRI_MIN - 1 if no thread is ready. */
+static int
+ready_max_priority (void) {
+	if (ready_bitmap == 0)
+		return PRI_MIN - 1;
+	return PRI_MIN + 63 - __builtin_clzll (ready_bitmap);
+}
+
+/* Changes the priority of T to PRIORITY.  If T is sitting in a
+   ready queue it is moved to the tail of the new level, so that
+   donation never leaves a thread queued at a stale priority. */
+void
+thread_change_priority (struct thread *t, int priority) {
+	enum intr_level old_level;
+
+	ASSERT (is_thread (t));
+	ASSERT (PRI_MIN <= priority && priority <= PRI_MAX);
+
+	old_level = intr_disable ();
+	if (t->status == THREAD_READY && t->priority != priority) {
+		ready_queue_remove (t);
+		t->priority = priority;
+		ready_queue_push (t);
+	} else
+		t->priority = priority;
+	intr_set_level (old_level);
 }
 
 /* Puts the current thread to sleep.  It will not be scheduled
@@ -309,9 +417,7 @@ thread_unblock (struct thread *t) {
 
 	old_level = intr_disable ();
 	ASSERT (t->status == THREAD_BLOCKED);
-	// list_push_back (&ready_list, &t->elem);
-  // * 추가 코드
-  list_insert_ordered(&ready_list, &t->elem, cmp_priority, NULL);
+	ready_queue_push (t);
 	t->status = THREAD_READY;
 	intr_set_level (old_level);
 }
@@ -358,6 +464,7 @@ thread_exit (void) {
 	/* Just set our status to dying and schedule another process.
 	   We will be destroyed during the call to schedule_tail(). */
 	intr_disable ();
+	list_remove (&thread_current ()->all_elem);
 	do_schedule (THREAD_DYING);
 	NOT_REACHED ();
 }
@@ -373,13 +480,13 @@ thread_yield (void) {
 
 	old_level = intr_disable ();
 	if (curr != idle_thread)
-    list_insert_ordered(&ready_list, &curr->elem, cmp_priority, NULL);
-  // list_push_back (&ready_list, &curr->elem);
+		ready_queue_push (curr);
 	do_schedule (THREAD_READY);
 	intr_set_level (old_level);
 }
 
 
+/* Puts the current thread to sleep until timer tick TICKS. */
 void thread_sleep(int64_t ticks) {
 	struct thread *curr = thread_current ();
 	enum intr_level old_level;
@@ -388,46 +495,85 @@ void thread_sleep(int64_t ticks) {
 
 	old_level = intr_disable ();
 	if (curr != idle_thread) {
-		curr->wakeup_tick = ticks; 
-		list_push_back (&sleep_list, &curr->elem);
-		if (ticks < get_next_tick_to_awake())
-			update_next_tick_to_awake(ticks);
+		curr->wakeup_tick = ticks;
+		wheel_insert (curr, wheel_tick + 1);
 	}
 	do_schedule (THREAD_BLOCKED);
 	intr_set_level (old_level);
 }
 
+/* Advances the timing wheel up to tick TICKS and wakes every
+   thread whose wakeup tick has been reached.  Called from the
+   timer interrupt on every tick. */
 void thread_awake(int64_t ticks) {
-	if (list_empty (&sleep_list))
-		return idle_thread;
-	else {
-		struct list_elem *temp = list_begin(&sleep_list);
-		int64_t min_value = INT64_MAX;
-
-		while (temp != list_tail(&sleep_list)) {
-			struct thread *cur = list_entry(temp, struct thread, elem);
-			if (cur->wakeup_tick <= ticks) {
-			  temp = list_remove(temp);
-				// list_push_back (&ready_list, &cur->elem);
-				// cur->status = THREAD_READY;
-				thread_unblock (cur);
-			} else {
-				if (cur->wakeup_tick < min_value) {
-					min_value = cur->wakeup_tick;
-				}
-				temp = list_next(temp);
-			}
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	if (sleeper_cnt == 0) {
+		wheel_tick = ticks;
+		return;
+	}
+
+	while (wheel_tick < ticks) {
+		struct list *slot;
+		int level;
+
+		wheel_tick++;
+		for (level = 1; level < WHEEL_LEVELS; level++) {
+			if ((wheel_tick >> (WHEEL_BITS * (level - 1))) & WHEEL_MASK)
+				break;
+			wheel_cascade (level);
+		}
+
+		slot = &sleep_wheel[0][wheel_tick & WHEEL_MASK];
+		while (!list_empty (slot)) {
+			struct thread *t = list_entry (list_pop_front (slot), struct thread, elem);
+			sleeper_cnt--;
+			if (t->wakeup_tick <= wheel_tick)
+				thread_unblock (t);
+			else
+				wheel_insert (t, wheel_tick);
 		}
-		update_next_tick_to_awake(min_value);
 	}
 }
 
-void update_next_tick_to_awake(int64_t ticks) {
-	next_tick_to_awake = ticks;
+/* Hashes T into the timing wheel by its wakeup tick, but no
+   earlier than tick EARLIEST, the first tick the wheel has not
+   yet drained. */
+static void
+wheel_insert (struct thread *t, int64_t earliest) {
+	int64_t expires = t->wakeup_tick < earliest ? earliest : t->wakeup_tick;
+	int64_t delta;
+	int level;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	delta = expires - wheel_tick;
+
+	for (level = 0; level < WHEEL_LEVELS - 1; level++)
+		if (delta < (1LL << (WHEEL_BITS * (level + 1))))
+			break;
+	/* Beyond the wheel's range, park the thread in the farthest
+	   slot; it is rehashed when that slot cascades. */
+	if (delta >= (1LL << (WHEEL_BITS * WHEEL_LEVELS)))
+		expires = wheel_tick + (1LL << (WHEEL_BITS * WHEEL_LEVELS)) - 1;
+
+	list_push_back (&sleep_wheel[level][(expires >> (WHEEL_BITS * level)) & WHEEL_MASK],
+			&t->elem);
+	sleeper_cnt++;
 }
 
-int64_t get_next_tick_to_awake(void) {
-	return next_tick_to_awake;
+/* Moves every thread in the current slot of LEVEL down into the
+   lower levels. */
+static void
+wheel_cascade (int level) {
+	struct list *slot =
+		&sleep_wheel[level][(wheel_tick >> (WHEEL_BITS * level)) & WHEEL_MASK];
+
+	while (!list_empty (slot)) {
+		struct thread *t = list_entry (list_pop_front (slot), struct thread, elem);
+		sleeper_cnt--;
+		wheel_insert (t, wheel_tick);
+	}
 }
 
 void donate_priority(void) {
@@ -437,9 +583,8 @@ void donate_priority(void) {
 	
 	while ((cur->wait_on_lock != NULL) && (depth < 8)) {
 		struct thread *nest_thread = cur->wait_on_lock->holder;
-		if (nest_thread->priority < priority) {
-    nest_thread->priority = priority;
-		}
+		if (nest_thread->priority < priority)
+			thread_change_priority (nest_thread, priority);
 		cur = nest_thread;
 		depth++;
 	}
@@ -486,6 +631,10 @@ void refresh_priority(void) {
 /* Sets the current thread's priority to NEW_PRIORITY. */
 void
 thread_set_priority (int new_priority) {
+	/* The MLFQS computes priorities itself. */
+	if (thread_mlfqs)
+		return;
+
 	thread_current ()->init_priority = new_priority;
 	// * 추가 코드
 	refresh_priority();
@@ -499,31 +648,87 @@ thread_get_priority (void) {
 	return thread_current ()->priority;
 }
 
-/* Sets the current thread's nice value to NICE. */
+/* Sets the current thread's nice value to NICE and recomputes
+   its priority, yielding if it no longer has the highest. */
 void
-thread_set_nice (int nice UNUSED) {
-	/* TODO: Your implementation goes here */
+thread_set_nice (int nice) {
+	struct thread *curr = thread_current ();
+	enum intr_level old_level;
+
+	ASSERT (NICE_MIN <= nice && nice <= NICE_MAX);
+
+	old_level = intr_disable ();
+	curr->nice = nice;
+	if (thread_mlfqs)
+		curr->priority = curr->init_priority = mlfqs_priority (curr);
+	intr_set_level (old_level);
+	test_max_priority ();
 }
 
 /* Returns the current thread's nice value. */
 int
 thread_get_nice (void) {
-	/* TODO: Your implementation goes here */
-	return 0;
+	return thread_current ()->nice;
 }
 
 /* Returns 100 times the system load average. */
 int
 thread_get_load_avg (void) {
-	/* TODO: Your implementation goes here */
-	return 0;
+	enum intr_level old_level = intr_disable ();
+	int load = fp_to_int_round (fp_mul_int (load_avg, 100));
+	intr_set_level (old_level);
+	return load;
 }
 
 /* Returns 100 times the current thread's recent_cpu value. */
 int
 thread_get_recent_cpu (void) {
-	/* TODO: Your implementation goes here */
-	return 0;
+	enum intr_level old_level = intr_disable ();
+	int recent = fp_to_int_round (fp_mul_int (thread_current ()->recent_cpu, 100));
+	intr_set_level (old_level);
+	return recent;
+}
+
+/* Returns the MLFQS priority of T,
+   PRI_MAX - (recent_cpu / 4) - (nice * 2), clamped to the valid
+   range. */
+static int
+mlfqs_priority (struct thread *t) {
+	int priority = fp_to_int (fp_sub (int_to_fp (PRI_MAX - t->nice * 2),
+				fp_div_int (t->recent_cpu, 4)));
+
+	if (priority < PRI_MIN)
+		return PRI_MIN;
+	if (priority > PRI_MAX)
+		return PRI_MAX;
+	return priority;
+}
+
+/* Once-per-second MLFQS bookkeeping: updates the load average,
+   then decays every thread's recent_cpu and recomputes its
+   priority, requeueing ready threads at their new level. */
+static void
+mlfqs_recalc_all (void) {
+	struct thread *curr = thread_current ();
+	int ready_threads = ready_cnt + (curr != idle_thread ? 1 : 0);
+	fixed_t coef;
+	struct list_elem *e;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	load_avg = fp_add (fp_mul (fp_div_int (int_to_fp (59), 60), load_avg),
+			fp_mul_int (fp_div_int (int_to_fp (1), 60), ready_threads));
+	coef = fp_div (fp_mul_int (load_avg, 2), fp_add_int (fp_mul_int (load_avg, 2), 1));
+
+	for (e = list_begin (&all_list); e != list_end (&all_list); e = list_next (e)) {
+		struct thread *t = list_entry (e, struct thread, all_elem);
+
+		if (t == idle_thread)
+			continue;
+		t->recent_cpu = fp_add_int (fp_mul (coef, t->recent_cpu), t->nice);
+		thread_change_priority (t, mlfqs_priority (t));
+		t->init_priority = t->priority;
+	}
 }
 
 /* Idle thread.  Executes when no other thread is ready to run.
@@ -578,6 +783,8 @@ kernel_thread (thread_func *function, void *aux) {
    NAME. */
 static void
 init_thread (struct thread *t, const char *name, int priority, int wakeup_tick) {
+	enum intr_level old_level;
+
 	ASSERT (t != NULL);
 	ASSERT (PRI_MIN <= priority && priority <= PRI_MAX);
 	ASSERT (name != NULL);
@@ -591,8 +798,14 @@ init_thread (struct thread *t, const char *name, int priority, int wakeup_tick)
 	t->wait_on_lock = NULL;
 	list_init(&t->donations);
 	t->wakeup_tick = wakeup_tick;
+	t->nice = NICE_DEFAULT;
+	t->recent_cpu = 0;
 	t->magic = THREAD_MAGIC;
 
+	old_level = intr_disable ();
+	list_push_back (&all_list, &t->all_elem);
+	intr_set_level (old_level);
+
 	// * USERPROG 추가
 	list_init(&t->children);
 }
@@ -604,10 +817,15 @@ init_thread (struct thread *t, const char *name, int priority, int wakeup_tick)
    idle_thread. */
 static struct thread *
 next_thread_to_run (void) {
-	if (list_empty (&ready_list))
+	struct thread *t;
+
+	if (ready_bitmap == 0)
 		return idle_thread;
-	else
-		return list_entry (list_pop_front (&ready_list), struct thread, elem);
+
+	t = list_entry (list_front (&ready_queues[ready_max_priority () - PRI_MIN]),
+			struct thread, elem);
+	ready_queue_remove (t);
+	return t;
 }
 
 /* Use iretq to launch the thread */
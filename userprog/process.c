@@ -124,7 +124,7 @@ duplicate_pte (uint64_t *pte, void *va, void *aux) {
 	/* 4. TODO: Duplicate parent's page to the new page and
 	 *    TODO: check whether parent's page is writable or not (set WRITABLE
 	 *    TODO: according to the result). */
-	memcpy(newpage, parent_page, PGSIZE);
+	page_copy(newpage, parent_page);
 	writable = is_writable(pte);
 
 	/* 5. Add new page to child's page table at address VA with WRITABLE
@@ -179,9 +179,7 @@ __do_fork (void *aux) {
 	struct file **table = parent->fdt;
 	while (cnt < FD_MAX) {
 		if (table[cnt]) {
-			lock_acquire(&filesys_lock);
 			current->fdt[cnt] = file_duplicate(table[cnt]);
-			lock_release(&filesys_lock);
 		} else {
 			current->fdt[cnt] = NULL;
 		}
@@ -218,6 +216,12 @@ process_exec (void *f_name) {
 	_if.eflags = FLAG_IF | FLAG_MBS;
 
 	/* We first kill the current context */
+#ifdef VM
+	/* Release every page before the page table goes away, so frames
+	 * shared copy-on-write with other processes are not freed with it. */
+	mmap_hash_kill (&thread_current ()->mmap_hash);
+	supplemental_page_table_kill (&thread_current ()->spt);
+#endif
 	process_cleanup ();
 
 	/* And then load the binary */
@@ -279,9 +283,7 @@ process_exit (void) {
 #endif
 
 	if (curr->run_file) {
-		// lock_acquire(&filesys_lock);
 		file_close(curr->run_file);
-		// lock_release(&filesys_lock);
 	}
 
 	int cnt = 2;
@@ -425,9 +427,7 @@ load (const char *file_name, struct intr_frame *if_) {
 	}
 
 	/* Open executable file. */
-	lock_acquire(&filesys_lock);
 	file = filesys_open (argv[0]);
-	lock_release(&filesys_lock);
 	// printf("--------open file argv %s---------\n", argv[0]);
 	if (file == NULL) {
 		printf ("load: %s: open failed\n", file_name);
@@ -438,9 +438,7 @@ load (const char *file_name, struct intr_frame *if_) {
 	t->run_file = file;
 	file_deny_write(file);
 
-	lock_acquire(&filesys_lock);
 	read_result = file_read (file, &ehdr, sizeof ehdr);
-	lock_release(&filesys_lock);
 	/* Read and verify executable header. */
 	if (read_result != sizeof ehdr
 			|| memcmp (ehdr.e_ident, "\177ELF\2\1\1", 7)
@@ -460,13 +458,9 @@ load (const char *file_name, struct intr_frame *if_) {
 
 		if (file_ofs < 0 || file_ofs > file_length (file))
 			goto done;
-		lock_acquire(&filesys_lock);
 		file_seek (file, file_ofs);
-		lock_release(&filesys_lock);
 
-		lock_acquire(&filesys_lock);
 		read_result = file_read (file, &phdr, sizeof phdr);
-		lock_release(&filesys_lock);
 
 		if (read_result != sizeof phdr)
 			goto done;
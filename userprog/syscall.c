@@ -10,8 +10,12 @@
 
 // * USERPROG 추가
 #include "threads/palloc.h"
+#include "threads/malloc.h"
 #include "filesys/filesys.h"
 #include "filesys/file.h"
+#include <iovec.h>
+#include <string.h>
+#include <limits.h>
 
 #include "vm/vm.h"
 #include "threads/vaddr.h"
@@ -36,8 +40,6 @@ void syscall_handler (struct intr_frame *);
 void
 syscall_init (void) {
 
-  lock_init(&filesys_lock);
-
 	write_msr(MSR_STAR, ((uint64_t)SEL_UCSEG - 0x10) << 48  |
 			((uint64_t)SEL_KCSEG) << 32);
 	write_msr(MSR_LSTAR, (uint64_t) syscall_entry);
@@ -97,6 +99,18 @@ syscall_handler (struct intr_frame *f UNUSED) {
     case SYS_CLOSE:
       close(f->R.rdi);
       break;
+    case SYS_READV:
+      f->R.rax = (uint64_t)readv(f->R.rdi, (const struct iovec *) f->R.rsi, f->R.rdx);
+      break;
+    case SYS_WRITEV:
+      f->R.rax = (uint64_t)writev(f->R.rdi, (const struct iovec *) f->R.rsi, f->R.rdx);
+      break;
+    case SYS_PREAD:
+      f->R.rax = (uint64_t)pread(f->R.rdi, (void *) f->R.rsi, f->R.rdx, f->R.r10);
+      break;
+    case SYS_PWRITE:
+      f->R.rax = (uint64_t)pwrite(f->R.rdi, (const void *) f->R.rsi, f->R.rdx, f->R.r10);
+      break;
     case SYS_MMAP:
       f->R.rax = mmap(f->R.rdi, f->R.rsi, f->R.rdx, f->R.r10, f->R.r8);
       break;
@@ -165,9 +179,7 @@ bool create (const char *file, unsigned initial_size) {
    * 파일 생성 성공 시 true 반환, 실패 시 false 반환
    */
   check_address(file);
-  lock_acquire(&filesys_lock);
   bool result = filesys_create(file, initial_size);
-  lock_release(&filesys_lock);
   return result;
 }
 
@@ -178,18 +190,14 @@ bool remove (const char *file) {
    * 파일 제거 성공 시 true 반환, 실패 시 false 반환
    */
   check_address(file);
-  lock_acquire(&filesys_lock);
   bool result = filesys_remove(file);
-  lock_release(&filesys_lock);
   return result;
 }
 
 int open (const char *file) {
   check_address(file);
   struct thread *cur = thread_current();
-  lock_acquire(&filesys_lock);
   struct file *fd = filesys_open(file);
-  lock_release(&filesys_lock);
   if (fd) {
     for (int i = 2; i < FD_MAX; i++) {
       if (!cur->fdt[i]) {
@@ -198,9 +206,7 @@ int open (const char *file) {
         return i;
       }
     }
-    lock_acquire(&filesys_lock);
     file_close(fd);
-    lock_release(&filesys_lock);
   }
   return -1;
 }
@@ -208,14 +214,46 @@ int open (const char *file) {
 int filesize (int fd) {
   struct file *file = thread_current()->fdt[fd];
   if (file) {
-    lock_acquire(&filesys_lock);
     int length = file_length(file);
-    lock_release(&filesys_lock);
     return length;
   }
   return -1;
 }
 
+/* 한 번에 pin 하는 user buffer 크기. */
+#define DIRECT_CHUNK (64 * 1024)
+
+/* FILE 과 user BUFFER 사이에서 SIZE 바이트를 옮긴다 (WRITE 이면 file 에 쓴다).
+ * 큰 요청이고 buffer 와 file 위치의 sector 내 offset 이 같으면, buffer 의
+ * page 를 pin 해두고 kernel bounce buffer 없이 disk 와 user frame 사이에서
+ * sector 단위로 직접 옮긴다. 정렬이 안 맞는 앞뒤 조각만 cache 를 거친다. */
+static int file_rw (struct file *file, void *buffer, unsigned size, bool write) {
+#ifdef VM
+  if (size >= PGSIZE
+      && ((uintptr_t) buffer - file_tell(file)) % DISK_SECTOR_SIZE == 0) {
+    unsigned done = 0;
+    while (done < size) {
+      unsigned chunk = size - done < DIRECT_CHUNK ? size - done : DIRECT_CHUNK;
+      int n;
+      /* file 에서 읽으면 user buffer 에 쓰게 된다. */
+      if (!vm_pin_buffer(buffer + done, chunk, !write))
+        break;
+      n = write ? file_write_direct(file, buffer + done, chunk)
+                : file_read_direct(file, buffer + done, chunk);
+      vm_unpin_buffer(buffer + done, chunk);
+      done += n;
+      if (n < (int) chunk)
+        return done;
+    }
+    if (done == size)
+      return done;
+    return done + (write ? file_write(file, buffer + done, size - done)
+                         : file_read(file, buffer + done, size - done));
+  }
+#endif
+  return write ? file_write(file, buffer, size) : file_read(file, buffer, size);
+}
+
 int read (int fd, void *buffer, unsigned size) {
   // puts("read!!");
   check_valid_buffer(buffer, size, true);
@@ -224,16 +262,12 @@ int read (int fd, void *buffer, unsigned size) {
   }
 
   if (fd == 0) {
-    lock_acquire(&filesys_lock);
     int byte = input_getc();
-    lock_release(&filesys_lock);
     return byte;
   }
   struct file *file = thread_current()->fdt[fd];
   if (file) {
-    lock_acquire(&filesys_lock);
-    int read_byte = file_read(file, buffer, size);
-    lock_release(&filesys_lock);
+    int read_byte = file_rw(file, buffer, size, false);
     return read_byte;
   }
   return -1;
@@ -247,36 +281,130 @@ int write (int fd UNUSED, const void *str, unsigned size) {
     return -1;
 
   if (fd == 1) {
-    lock_acquire(&filesys_lock);
-	  putbuf(str, size);
-    lock_release(&filesys_lock);
+    putbuf(str, size);
     return size;
   }
 
   struct file *file = thread_current()->fdt[fd];
   if (file) {
-    lock_acquire(&filesys_lock);
-    int write_byte = file_write(file, str, size);
-    lock_release(&filesys_lock);
+    int write_byte = file_rw(file, (void *) str, size, true);
     return write_byte;
   }
 }
 
+/* user 주소 BUFFER 부터 SIZE 바이트가 모두 mapping 되어 있는지 page 마다
+ * 한 번씩 검사한다. STORE 이면 kernel 이 쓸 수 있는지도 본다.
+ * 잘못된 주소면 process 를 종료한다. */
+static void check_user_range (const void *buffer, size_t size, bool store) {
+  struct thread *cur = thread_current();
+  const void *va;
+
+  if (size == 0)
+    return;
+  if (buffer + size < buffer)
+    exit(-1);
+  for (va = pg_round_down(buffer); va < buffer + size; va += PGSIZE) {
+    check_address((void *) va);
+    if (store && !spt_find_page(&cur->spt, (void *) va)->writable)
+      exit(-1);
+  }
+}
+
+/* user 의 iovec 배열 UIOV 와 가리키는 buffer 들을 transfer 전에 한 번에
+ * 검사하고, kernel 로 복사한 배열을 *KIOV 에 둔다. STORE 이면 buffer 에
+ * 쓰는 readv 이다. 잘못된 주소면 exit 하므로 검사를 모두 마친 뒤에
+ * malloc 한다. 총 길이를 돌려주고, 개수나 총 길이가 너무 크거나 메모리가
+ * 없으면 -1 을 돌려준다. 성공하면 caller 가 *KIOV 를 free 한다. */
+static int copy_iovec (struct iovec **kiov, const struct iovec *uiov,
+                       int iovcnt, bool store) {
+  size_t total = 0;
+
+  if (iovcnt < 0 || iovcnt > IOV_MAX)
+    return -1;
+  check_user_range(uiov, iovcnt * sizeof *uiov, false);
+
+  for (int i = 0; i < iovcnt; i++) {
+    if (uiov[i].iov_len > INT_MAX - total)
+      return -1;
+    total += uiov[i].iov_len;
+    check_user_range(uiov[i].iov_base, uiov[i].iov_len, store);
+  }
+
+  *kiov = malloc(iovcnt * sizeof *uiov);
+  if (*kiov == NULL && iovcnt > 0)
+    return -1;
+  memcpy(*kiov, uiov, iovcnt * sizeof *uiov);
+  return total;
+}
+
+int readv (int fd, const struct iovec *iov, int iovcnt) {
+  struct iovec *kiov;
+  int result = -1;
+
+  if (copy_iovec(&kiov, iov, iovcnt, true) < 0)
+    return -1;
+  if (fd >= 2 && fd < FD_MAX) {
+    struct file *file = thread_current()->fdt[fd];
+    if (file)
+      result = file_readv(file, kiov, iovcnt);
+  }
+  free(kiov);
+  return result;
+}
+
+int writev (int fd, const struct iovec *iov, int iovcnt) {
+  struct iovec *kiov;
+  int total = copy_iovec(&kiov, iov, iovcnt, false);
+  int result = -1;
+
+  if (total < 0)
+    return -1;
+  if (fd == 1) {
+    for (int i = 0; i < iovcnt; i++)
+      putbuf(kiov[i].iov_base, kiov[i].iov_len);
+    result = total;
+  } else if (fd >= 2 && fd < FD_MAX) {
+    struct file *file = thread_current()->fdt[fd];
+    if (file)
+      result = file_writev(file, kiov, iovcnt);
+  }
+  free(kiov);
+  return result;
+}
+
+/* file 위치를 바꾸지 않고 OFFSET 부터 읽는다. */
+int pread (int fd, void *buffer, unsigned size, off_t offset) {
+  check_user_range(buffer, size, true);
+  if (fd < 2 || fd >= FD_MAX || offset < 0 || size > INT_MAX)
+    return -1;
+  struct file *file = thread_current()->fdt[fd];
+  if (file)
+    return file_read_at(file, buffer, size, offset);
+  return -1;
+}
+
+/* file 위치를 바꾸지 않고 OFFSET 부터 쓴다. */
+int pwrite (int fd, const void *buffer, unsigned size, off_t offset) {
+  check_user_range(buffer, size, false);
+  if (fd < 2 || fd >= FD_MAX || offset < 0 || size > INT_MAX)
+    return -1;
+  struct file *file = thread_current()->fdt[fd];
+  if (file)
+    return file_write_at(file, buffer, size, offset);
+  return -1;
+}
+
 void seek (int fd, unsigned position) {
   struct file *curfile = thread_current()->fdt[fd];
   if (curfile) {
-    lock_acquire(&filesys_lock);
     file_seek(curfile, position);
-    lock_release(&filesys_lock);
   }
 }
 
 unsigned tell (int fd) {
   struct file *curfile = thread_current()->fdt[fd];
   if (curfile) {
-    lock_acquire(&filesys_lock);
     unsigned result = file_tell(curfile);
-    lock_release(&filesys_lock);
     return result;
   }
   return -1;
@@ -287,9 +415,7 @@ void close (int fd) {
   struct file * file = thread_current()->fdt[fd];
   if (file) {
     thread_current()->fdt[fd] = NULL;
-    lock_acquire(&filesys_lock);
     file_close(file);
-    lock_release(&filesys_lock);
   }
 }
 
@@ -334,9 +460,7 @@ void *mmap (void *addr, size_t length, int writable, int fd, off_t offset) {
   if(addr == 0 || length == 0 || KERN_BASE - USER_STACK < length || fd == 0 || fd == 1|| pg_ofs (addr) != 0 || length < offset || is_kernel_vaddr(addr))
     return NULL;
   struct file *f = thread_current()->fdt[fd];
-  lock_acquire(&filesys_lock);
   struct file *open_file = file_reopen(f);
-  lock_release(&filesys_lock);
   return do_mmap(addr, length, writable, open_file, offset);
 }
 
@@ -345,17 +469,3 @@ void munmap (void *addr) {
     exit(-1);
   };
 }
-
-off_t file_write_with_lock (struct file *file, void *buffer, off_t size, off_t file_ofs) {
-    lock_acquire(&filesys_lock);
-    off_t ret = file_write_at (file, buffer, size, file_ofs);
-    lock_release(&filesys_lock);
-    return ret;
-}
-
-off_t file_read_with_lock (struct file *file, void *buffer, off_t size, off_t file_ofs) {
-    lock_acquire(&filesys_lock);
-    off_t ret = file_read_at (file, buffer, size, file_ofs);
-    lock_release(&filesys_lock);
-    return ret;
-}
@@ -4,6 +4,10 @@
 #include "devices/disk.h"
 #include "lib/kernel/bitmap.h"
 #include "threads/mmu.h"
+
+/* Number of swap disk sectors that hold one page. */
+#define SECTORS_PER_PAGE (PGSIZE / DISK_SECTOR_SIZE)
+
 /* DO NOT MODIFY BELOW LINE */
 static struct disk *swap_disk;
 static bool anon_swap_in (struct page *page, void *kva);
@@ -21,6 +25,7 @@ static const struct page_operations anon_ops = {
 static struct swap_table {
 	size_t size;
 	struct bitmap *used;
+	uint16_t *ref_cnt;	/* # of pages sharing each slot, after fork. */
 };
 
 static struct swap_table *swap_table;
@@ -32,9 +37,10 @@ vm_anon_init (void) {
 	// puts("anon int!!");
 	swap_disk = disk_get(1, 1);
 	swap_table = calloc(1, sizeof(struct swap_table));
-	swap_table->size = disk_size(swap_disk) / 8;
+	swap_table->size = disk_size(swap_disk) / SECTORS_PER_PAGE;
 	// printf("size!! : %d\n", swap_table->size);
 	swap_table->used = bitmap_create(swap_table->size);
+	swap_table->ref_cnt = calloc(swap_table->size, sizeof *swap_table->ref_cnt);
 	lock_init(&swap_lock);
 	
 	// printf("bits size!!!! %d\n", bitmap_size (swap_table->used));
@@ -50,79 +56,80 @@ anon_initializer (struct page *page, enum vm_type type, void *kva) {
 	page->operations = &anon_ops;
 	// printf("anon initialize!!!!!!!!222\n");
 	struct anon_page *anon_page = &page->anon;
+	page->swap_slot = SWAP_SLOT_NONE;
 	return true;
 }
 
-bool
-anon_child_swap_in (struct page *parent_page, void *kva) {
-	// printf("anon swap in!!! page->va %p, kva %p\n", page->va, kva);
-	struct anon_page *anon_page = &parent_page->anon;
-	size_t idx = parent_page->swap_slot;
-	void *addr = kva;
-	for(int i = 0; i < 8; i++) {
-		lock_acquire(&swap_lock);
-		disk_read(swap_disk, idx * 8 + i, addr);
-		lock_release(&swap_lock);
-		addr += DISK_SECTOR_SIZE;
-	}
-	parent_page->swap_slot = NULL;
-	return true;
+/* Makes DST, a child's copy of the swapped-out page SRC, share SRC's
+ * swap slot instead of reading it back in at fork time. */
+void
+anon_swap_share (struct page *dst, struct page *src) {
+	ASSERT (src->swap_slot != SWAP_SLOT_NONE);
+
+	dst->swap_slot = src->swap_slot;
+	lock_acquire(&swap_lock);
+	swap_table->ref_cnt[src->swap_slot]++;
+	lock_release(&swap_lock);
+}
+
+/* Drops one reference to swap slot IDX, freeing it with the last one. */
+static void
+swap_slot_release (size_t idx) {
+	lock_acquire(&swap_lock);
+	if (--swap_table->ref_cnt[idx] == 0)
+		bitmap_set(swap_table->used, idx, false);
+	lock_release(&swap_lock);
 }
 
 
-/* Swap in the page by read contents from the swap disk. */
+/* Swap in the page by read contents from the swap disk.
+ * The whole slot is read with one multi-sector command. */
 static bool
 anon_swap_in (struct page *page, void *kva) {
 	// printf("anon swap in!!! page->va %p, kva %p\n", page->va, kva);
 	struct anon_page *anon_page = &page->anon;
 	size_t idx = page->swap_slot;
-	void *addr = kva;
-  
-	for(int i = 0; i < 8; i++) {
-		lock_acquire(&swap_lock);
-		disk_read(swap_disk, idx * 8 + i, addr);
-		lock_release(&swap_lock);
-		addr += DISK_SECTOR_SIZE;
-	}
-	// if(page->is_child) {
-	// 	page->is_child = false;
-	// } else {
-	lock_acquire(&swap_lock);
-	bitmap_set(swap_table->used, idx, false);
-	lock_release(&swap_lock);
-	page->swap_slot = NULL;
-	// }
+
+	disk_read_multi(swap_disk, idx * SECTORS_PER_PAGE, SECTORS_PER_PAGE, kva);
+	swap_slot_release(idx);
+	page->swap_slot = SWAP_SLOT_NONE;
 	return true;
 }
 
-/* Swap out the page by writing contents to the swap disk. */
+/* Swap out the page by writing contents to the swap disk.
+ * Every page sharing PAGE's frame is unmapped and pointed at the same
+ * swap slot, which is freed once all of them have swapped back in.
+ * Called without frame_lock; the pages stay on the frame for
+ * vm_evict_frame() to detach once the write is done.
+ * The slot is allocated once under swap_lock and the page goes out as
+ * one multi-sector write; the disk driver serializes the I/O itself. */
 static bool
 anon_swap_out (struct page *page) {
 	// printf("anon swap out!!! page->va %p\n", page->va);
 	struct anon_page *anon_page = &page->anon;
+	struct frame *frame = page->frame;
+	struct list_elem *e;
+
 	lock_acquire(&swap_lock);
 	size_t idx = bitmap_scan_and_flip(swap_table->used, 0, 1, false);
-	lock_release(&swap_lock);	
+	if (idx != BITMAP_ERROR)
+		swap_table->ref_cnt[idx] = frame->ref_cnt;
+	lock_release(&swap_lock);
 
 	if (idx == BITMAP_ERROR) {
 		// puts("BITMAP_ERROR!!!!!!!!");
 		return false;
 	}
-	page->swap_slot = idx;
 
-	// printf("anon swap slot!!! idx %u\n", idx);
-	void *addr = page->va;
-	for(int i = 0; i < 8; i++) {
-		lock_acquire(&swap_lock);
-		disk_write(swap_disk, idx * 8 + i, addr);
-		lock_release(&swap_lock);	
-		addr += DISK_SECTOR_SIZE;
+	/* Unmap every sharer first so no one writes the frame under us. */
+	for (e = list_begin(&frame->pages); e != list_end(&frame->pages); e = list_next(e)) {
+		struct page *p = list_entry(e, struct page, frame_elem);
+		p->swap_slot = idx;
+		pml4_clear_page(p->pml4, p->va);
 	}
-	// del_frame_from_frame_table(page->frame);
-	pml4_clear_page(thread_current()->pml4, page->va);
-	page->frame = NULL;
-	// printf("anon swap del_frame_from_frame_table!!!\n");
-	// delete_frame(page);
+
+	// printf("anon swap slot!!! idx %u\n", idx);
+	disk_write_multi(swap_disk, idx * SECTORS_PER_PAGE, SECTORS_PER_PAGE, frame->kva);
 	return true;
 }
 
@@ -130,4 +137,6 @@ anon_swap_out (struct page *page) {
 static void
 anon_destroy (struct page *page) {
 	struct anon_page *anon_page = &page->anon;
+	if (page->frame == NULL && page->swap_slot != SWAP_SLOT_NONE)
+		swap_slot_release(page->swap_slot);
 }
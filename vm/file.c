@@ -42,7 +42,7 @@ file_backed_swap_in (struct page *page, void *kva) {
 	// printf("read bytes %d, zero bytes %d\n", page->read_bytes, page->zero_bytes);
 	struct file_page *file_page = &page->file;
 	// printf("file_length %d\n", file_length(&page->f));
-	if (file_read_with_lock(page->f, kva, page->read_bytes, page->offset) != (int) page->read_bytes) 
+	if (file_read_at(page->f, kva, page->read_bytes, page->offset) != (int) page->read_bytes) 
 		return false;
 	if(kva+page->read_bytes != PGSIZE) {
 		memset (kva + page->read_bytes, 0, page->zero_bytes);
@@ -50,17 +50,26 @@ file_backed_swap_in (struct page *page, void *kva) {
 	return true;
 }
 
-/* Swap out the page by writeback contents to the file. */
+/* Swap out the page by writeback contents to the file.
+ * Every page sharing PAGE's frame is unmapped along with it.  Called
+ * without frame_lock; the pages stay on the frame for vm_evict_frame()
+ * to detach once the write is done. */
 static bool
 file_backed_swap_out (struct page *page) {
 	struct file_page *file_page UNUSED = &page->file;
-	if(pml4_is_dirty(thread_current()->pml4, page->va)) {
-		pml4_set_dirty(thread_current()->pml4, page->va, false);
-		file_write_with_lock(page->f, page->va, page->read_bytes, page->offset);
+	struct frame *frame = page->frame;
+	struct list_elem *e;
+
+	for (e = list_begin(&frame->pages); e != list_end(&frame->pages); e = list_next(e)) {
+		struct page *p = list_entry(e, struct page, frame_elem);
+		/* Unmap before testing the dirty bit so the page cannot be
+		 * written behind our back. */
+		pml4_clear_page(p->pml4, p->va);
+		if(pml4_is_dirty(p->pml4, p->va)) {
+			pml4_set_dirty(p->pml4, p->va, false);
+			file_write_at(p->f, frame->kva, p->read_bytes, p->offset);
+		}
 	}
-	// del_frame_from_frame_table(page->frame);
-	pml4_clear_page(thread_current()->pml4, page->va);
-	page->frame = NULL;
 	return true;
 }
 
@@ -75,14 +84,30 @@ void *
 do_mmap (void *addr, size_t length, int writable,
 		struct file *file, off_t offset) {
 	struct thread *cur = thread_current();
+	off_t file_len = file_length(file);
+
+	/* Only the part of the file past OFFSET and inside the mapping
+	 * is backed by it; dirty pages are written back only there, so
+	 * eviction never grows the file. */
+	size_t read_bytes = offset < file_len ? file_len - offset : 0;
+	size_t zero_bytes;
+
+	if (read_bytes > length)
+		read_bytes = length;
+	zero_bytes = length - read_bytes;
+
+	/* Eviction writes dirty pages back while faults on them wait for
+	 * it, so it must not have to fill holes, which takes the inode's
+	 * lock exclusively while other holders of it may be faulting.  Give
+	 * the holes disk sectors now instead. */
+	if (writable && read_bytes > 0 && !file_fill(file, read_bytes, offset))
+		return NULL;
+
   	struct mmap_file *mf = calloc(1, sizeof(struct mmap_file));
 	list_init(&mf->vme_list);
 	mf->file = file;
 	mf->va = addr;
 
-	size_t read_bytes = file_length(file);
-	size_t zero_bytes = length - read_bytes;
-
 	while (0 < read_bytes) {
 		/* Do calculate how to fill this page.
 		 * We will read PAGE_READ_BYTES bytes from FILE
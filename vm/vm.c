@@ -9,8 +9,54 @@
 #include "threads/palloc.h"
 #include "lib/string.h"
 #include "devices/disk.h"
+#include "threads/synch.h"
+#include "userprog/syscall.h"
+#include "filesys/file.h"
+#include "filesys/inode.h"
+#include <iovec.h>
 #define ONE_MB (1 << 20) // 1MB    
 
+/* Read-ahead window bounds, in pages beyond the faulting one. */
+#define RA_MIN_PAGES 2
+#define RA_MAX_PAGES 16
+
+/* Frame table: one entry per user pool page, indexed by page number
+ * relative to FRAME_BASE. */
+static struct frame *frame_table;
+static size_t frame_cnt;
+static uint8_t *frame_base;
+static size_t lru_clock;          /* Index of the next frame to inspect. */
+
+/* Protects the frame table, every frame's page list and the zero pool. */
+static struct lock frame_lock;
+
+/* Signaled, with frame_lock, when a frame's eviction finishes. */
+static struct condition evict_done;
+
+/* User pool accounting, in pages.  FRAMES_USED counts pages taken from
+ * palloc, including those parked in the zero pool. */
+static size_t frames_usable;
+static size_t frames_used;
+
+/* Pages the reclaim daemon has already zeroed, ready for vm_get_frame(). */
+static void **zero_pool;
+static size_t zero_cnt;
+
+/* Reclaim daemon watermarks, in pages.  The daemon wakes when fewer than
+ * KSWAPD_LOW frames can be handed out without eviction and reclaims until
+ * KSWAPD_HIGH can; it keeps up to KSWAPD_ZERO of them pre-zeroed.  Set
+ * from the kernel command line; a KSWAPD_LOW of 0 disables the daemon. */
+size_t kswapd_low = 16;
+size_t kswapd_high = 32;
+size_t kswapd_zero = 8;
+
+static struct semaphore kswapd_wakeup;
+static bool kswapd_awake;         /* Woken, or about to be. */
+
+static void kswapd (void *aux);
+static void kswapd_poke (void);
+static void register_fault_inspect_intr (void);
+
 /* Initializes the virtual memory subsystem by invoking each subsystem's
  * intialize codes. */
 void
@@ -23,8 +69,29 @@ vm_init (void) {
 	register_inspect_intr ();
 	/* DO NOT MODIFY UPPER LINES. */
 	/* TODO: Your code goes here. */
-	list_init(&frame_table);
-	lru_clock = list_head(&frame_table);
+	frame_base = palloc_user_pool_range(&frame_cnt);
+	frame_table = calloc(frame_cnt, sizeof *frame_table);
+	if (frame_table == NULL)
+		PANIC("out of memory for the frame table");
+	for (size_t i = 0; i < frame_cnt; i++)
+		list_init(&frame_table[i].pages);
+	lru_clock = 0;
+	lock_init(&frame_lock);
+	cond_init(&evict_done);
+
+	/* Never keep more than a quarter of memory in reserve. */
+	frames_usable = palloc_user_free_cnt();
+	if (kswapd_high > frames_usable / 4)
+		kswapd_high = frames_usable / 4;
+	if (kswapd_low > kswapd_high)
+		kswapd_low = kswapd_high;
+	if (kswapd_zero > kswapd_high)
+		kswapd_zero = kswapd_high;
+	zero_pool = calloc(kswapd_zero + 1, sizeof *zero_pool);
+	sema_init(&kswapd_wakeup, 0);
+	if (kswapd_low > 0)
+		thread_create("kswapd", PRI_DEFAULT, kswapd, NULL);
+	register_fault_inspect_intr();
 }
 
 /* Get the type of the page. This function is useful if you want to know the
@@ -46,7 +113,21 @@ static struct frame *vm_get_victim (void);
 static bool vm_do_claim_page (struct page *page);
 static struct frame *vm_evict_frame (void);
 static struct frame *vm_get_frame (void);
-static struct list_elem *get_next_lru_clock();
+static struct frame *page_frame (struct page *page);
+static bool frame_test_and_clear_accessed (struct frame *frame);
+static bool frame_is_dirty (struct frame *frame);
+static bool vm_share_frame (struct page *child, struct page *parent);
+static void frame_add_page (struct frame *frame, struct page *page);
+static void frame_unmap_page (struct page *p);
+static void frame_unpin (struct frame *frame);
+static void frame_free (struct frame *frame);
+static bool page_file_source (struct page *page, struct file **file, off_t *ofs,
+		size_t *read_bytes);
+static bool page_adopt_file_data (struct page *page, void *kva,
+		size_t read_bytes);
+static bool vm_map_loaded_page (struct page *page);
+static void vm_read_ahead (struct supplemental_page_table *spt,
+		struct page *page, struct file *file, off_t ofs, bool sequential);
 
 /* Create the pending page object with initializer. If you want to create a
  * page, do not create it directly and make it through this function or
@@ -69,19 +150,23 @@ vm_alloc_page_with_initializer (enum vm_type type, void *upage, bool writable,
 		/* 부모의 페이지를 복사한 경우 */
 		if (type & VM_MARKER_1) {
 			struct page *parent_page = (struct page *)aux;
-			/* 보라 : 부모 페이지가 uninit 일 경우 lazyload에서 부모의 aux가 free 될 수 있음. calloc?memcpy? */
-			void *_aux;
-			if(VM_TYPE(parent_page->operations->type) == VM_UNINIT) {
-				_aux = (struct file_info*)calloc(1, sizeof(struct file_info));
-				memcpy(_aux, (parent_page->uninit).aux, sizeof(struct file_info));
-			}
+			bool parent_uninit = VM_TYPE(parent_page->operations->type) == VM_UNINIT;
+			bool (*initializer) (struct page *, enum vm_type, void *) =
+				VM_TYPE(type) == VM_FILE ? file_backed_initializer : anon_initializer;
 
-			if(VM_TYPE(type) == VM_ANON) {
-				uninit_new(p, pg_round_down(upage), init, VM_TYPE(type), _aux, anon_initializer);
-			}
-
-			if(VM_TYPE(type) == VM_FILE) {
-				uninit_new(p, pg_round_down(upage), init, VM_TYPE(type), _aux, file_backed_initializer);
+			if (parent_uninit) {
+				/* 부모 페이지가 uninit 일 경우 lazyload에서 부모의 aux가 free 될 수 있으므로 복사 */
+				struct file_info *_aux = NULL;
+				if (parent_page->uninit.aux != NULL) {
+					_aux = (struct file_info*)calloc(1, sizeof(struct file_info));
+					memcpy(_aux, parent_page->uninit.aux, sizeof(struct file_info));
+				}
+				uninit_new(p, pg_round_down(upage), parent_page->uninit.init,
+						VM_TYPE(type), _aux, initializer);
+			} else {
+				/* 이미 초기화된 페이지는 같은 타입으로 바로 초기화 */
+				uninit_new(p, pg_round_down(upage), NULL, VM_TYPE(type), NULL, initializer);
+				initializer(p, VM_TYPE(type), NULL);
 			}
 
 			p->va = pg_round_down(upage);
@@ -90,23 +175,22 @@ vm_alloc_page_with_initializer (enum vm_type type, void *upage, bool writable,
 			p->offset = parent_page->offset;
 			p->read_bytes = parent_page->read_bytes;
 			p->zero_bytes = parent_page->zero_bytes;
-			p->swap_slot = parent_page->swap_slot;
+			p->pml4 = thread_current()->pml4;
 
 			/* Add the page to the process's address space. */
-			// printf("spt insert page in fork copy by parent!!!!!! va %p\n", p->va);
 			spt_insert_page(spt, p);
-			if(parent_page->frame != NULL) {
-				vm_do_claim_page(p);
-				memcpy(p->frame->kva, parent_page->frame->kva, PGSIZE);
-			}
+			if (parent_uninit)
+				return true;
 
-			if(parent_page->frame == NULL) {
-				if(parent_page->swap_slot != NULL) {
-					vm_do_claim_page(p);
-					anon_child_swap_in(parent_page, p->frame->kva);
-				}
-			}
-			return true;
+			/* 메모리에 있는 페이지는 frame을, 스왑된 페이지는 swap slot을 공유 */
+			bool shared = true;
+			lock_acquire(&frame_lock);
+			if (page_frame(parent_page) != NULL)
+				shared = vm_share_frame(p, parent_page);
+			else if (VM_TYPE(type) == VM_ANON)
+				anon_swap_share(p, parent_page);
+			lock_release(&frame_lock);
+			return shared;
 		}
 
 		switch (VM_TYPE(type))
@@ -171,94 +255,212 @@ spt_remove_page (struct supplemental_page_table *spt, struct page *page) {
 	return true;
 }
 
-/* Get the struct frame, that will be evicted. */
+/* Get the struct frame, that will be evicted.
+ * Second-chance clock over the frame table.  A frame counts as recently
+ * used if any of its sharers touched it, so the accessed bits of every
+ * mapping are tested (and cleared) through the sharer's own page table.
+ * Dirty file-backed frames are spared for one sweep.  Caller must hold
+ * frame_lock. */
 static struct frame *
 vm_get_victim (void) {
-	// printf("vm_get_victim\n");
-	struct frame *victim = NULL;
-	struct thread *cur = thread_current();
-	int cnt = list_size(&frame_table);
+	size_t cnt = frame_cnt;
+	size_t limit = frame_cnt * 3;
+
 	 /* TODO: The policy for eviction is up to you. */
-	while(true) {
-		struct list_elem *clock = get_next_lru_clock();
-		if (clock == NULL) {
-			return NULL;
-			// printf("clock is nullllllllll!\n\n");
-		}
-		struct page *cur_page = list_entry(clock, struct frame, frame_elem)->page;
-		if(!pml4_is_accessed(cur->pml4, cur_page->va) && cur_page->frame != NULL) {
-			if(VM_TYPE(page_get_type(cur_page)) == VM_FILE) {
-				if(!pml4_is_dirty(cur->pml4, cur_page->va) || cnt == 0) {
-					victim = cur_page->frame;
-					break;
-				}
-			}
-			if(VM_TYPE(page_get_type(cur_page)) == VM_ANON) {
-				victim = cur_page->frame;
-				break;
-			}
-		}
-		cnt -= 1;
-		pml4_set_accessed(cur->pml4, cur_page->va, false);
+	while (limit-- > 0) {
+		struct frame *cur_frame = &frame_table[lru_clock];
+		lru_clock = (lru_clock + 1) % frame_cnt;
+		if (cnt > 0)
+			cnt--;
+
+		if (cur_frame->kva == NULL || cur_frame->pin_cnt > 0
+				|| list_empty(&cur_frame->pages))
+			continue;
+		if (frame_test_and_clear_accessed(cur_frame))
+			continue;
+
+		struct page *cur_page = list_entry(list_front(&cur_frame->pages), struct page, frame_elem);
+		if (VM_TYPE(page_get_type(cur_page)) == VM_ANON)
+			return cur_frame;
+		if (VM_TYPE(page_get_type(cur_page)) == VM_FILE
+				&& (!frame_is_dirty(cur_frame) || cnt == 0))
+			return cur_frame;
 	}
-	// printf("vm_get_victim done! kva %p, va %p\n", victim->kva, victim->page->va);
-	return victim;
+	return NULL;
 }
 
-/* Evict one page and return the corresponding frame.
- * Return NULL on error.*/
+/* Evict one page and return the corresponding frame, with no pages and
+ * pinned.  Return NULL on error.  Takes frame_lock itself, but drops it
+ * while the victim is written out, so that other faults go on; only
+ * those that touch a page of the victim wait, in page_frame(), until
+ * the victim's pages point to where their contents went.
+ * Writing back a dirty file-backed frame takes only the file's inode lock
+ * shared, which a faulting reader or writer of the same file already holds
+ * shared, so no file system lock is needed here. */
 static struct frame *
 vm_evict_frame (void) {
-	// printf("vm_evict_frame\n");
-	struct frame *victim = vm_get_victim ();
-	/* TODO: swap out the victim and return the evicted frame. */
-	if(victim != NULL) {
-		// printf("evict frame is not null!!\n");
-		struct thread *cur = thread_current();
-		struct page *found_p = victim->page;
-		// printf("evict frame switch %d\n", page_get_type(found_p));
-		switch(VM_TYPE(page_get_type(found_p))) {
-			case VM_ANON:
-				swap_out(found_p);
-				break;
-			case VM_FILE:
-				// puts("file!!!!");
-				swap_out(found_p);
-				break;
-		}
+	struct frame *victim;
+	struct page *found_p;
+	bool success;
+
+	lock_acquire(&frame_lock);
+	victim = vm_get_victim ();
+	if (victim != NULL) {
+		victim->pin_cnt++;
+		victim->evicting = true;
 	}
-	// printf("vm_evict_frame done! kva %p, va %p\n", victim->kva, victim->page->va);
-	return victim;
+	lock_release(&frame_lock);
+	if (victim == NULL)
+		return NULL;
+
+	/* The victim's page list cannot change meanwhile: everyone who
+	 * would change it waits in page_frame() first. */
+	found_p = list_entry(list_front(&victim->pages), struct page, frame_elem);
+	success = swap_out(found_p);
+
+	lock_acquire(&frame_lock);
+	if (success) {
+		while (!list_empty(&victim->pages)) {
+			struct page *p = list_entry(list_pop_front(&victim->pages),
+					struct page, frame_elem);
+			p->frame = NULL;
+		}
+		victim->ref_cnt = 0;
+	} else
+		victim->pin_cnt--;
+	victim->evicting = false;
+	cond_broadcast(&evict_done, &frame_lock);
+	lock_release(&frame_lock);
+	return success ? victim : NULL;
+}
+
+/* Returns PAGE's frame, or a null pointer if it has none, first waiting
+ * for the frame to finish being evicted if it is.  Caller must hold
+ * frame_lock. */
+static struct frame *
+page_frame (struct page *page) {
+	while (page->frame != NULL && page->frame->evicting)
+		cond_wait(&evict_done, &frame_lock);
+	return page->frame;
 }
 
 /* palloc() and get frame. If there is no available page, evict the page
  * and return it. This always return valid address. That is, if the user pool
  * memory is full, this function evicts the frame to get the available memory
- * space.*/
+ * space.
+ * Pages pre-zeroed by the reclaim daemon are used first, so the common
+ * fault does neither zeroing nor disk I/O.  The frame comes back zeroed,
+ * with no pages and pinned; the caller unpins it once it is filled in. */
 static struct frame *
 vm_get_frame (void) {
 	struct frame *frame = NULL;
-	/* TODO: Fill this function. */
-	void* kva = palloc_get_page(PAL_USER | PAL_ZERO);
-	if (kva == NULL) {
-		// printf("frame fullLllllllll!!!!\n");
-		frame = vm_evict_frame();
-		// pml4_clear_page(thread_current()->pml4, frame->page->va);
-		// printf("add frame to evict !!!!! %p\n", frame->kva);
-		// PANIC("todo vm_get_frame");
-	} else {
-		frame = (struct frame *)calloc(1, sizeof(struct frame));
+	void *kva;
+
+	lock_acquire(&frame_lock);
+	if (zero_cnt > 0)
+		kva = zero_pool[--zero_cnt];
+	else if ((kva = palloc_get_page(PAL_USER | PAL_ZERO)) != NULL)
+		frames_used++;
+	if (kva != NULL) {
+		frame = frame_lookup(kva);
+		ASSERT (list_empty(&frame->pages));
 		frame->kva = kva;
-		add_frame_to_frame_table(frame);
+		frame->ref_cnt = 0;
+		frame->pin_cnt = 1;
+	}
+	kswapd_poke();
+	lock_release(&frame_lock);
+
+	if (frame == NULL) {
+		frame = vm_evict_frame();
+		if (frame == NULL)
+			PANIC("vm_get_frame: no frame can be evicted");
+		page_zero(frame->kva);
 	}
-	frame->page = NULL;
-	// printf("add frame to frame table\n");
-	ASSERT (frame != NULL);
-	ASSERT (frame->page == NULL);
-	// puts("done get frame+++++++++++");
 	return frame;
 }
 
+/* Returns the number of frames vm_get_frame() can hand out without
+ * evicting.  Caller must hold frame_lock. */
+static size_t
+frames_available (void) {
+	return frames_usable - frames_used + zero_cnt;
+}
+
+/* Wakes the reclaim daemon if the free frames ran below the low
+ * watermark.  Caller must hold frame_lock. */
+static void
+kswapd_poke (void) {
+	if (kswapd_low > 0 && !kswapd_awake && frames_available() < kswapd_low) {
+		kswapd_awake = true;
+		sema_up(&kswapd_wakeup);
+	}
+}
+
+/* Evicts one frame and returns it to the user pool, if fewer than
+ * kswapd_high frames are available.  Returns true if a frame was freed. */
+static bool
+kswapd_reclaim_one (void) {
+	struct frame *victim;
+	bool low;
+
+	lock_acquire(&frame_lock);
+	low = frames_available() < kswapd_high;
+	lock_release(&frame_lock);
+	if (!low || (victim = vm_evict_frame()) == NULL)
+		return false;
+
+	lock_acquire(&frame_lock);
+	victim->pin_cnt = 0;
+	frame_free(victim);
+	lock_release(&frame_lock);
+	return true;
+}
+
+/* Moves free user pool pages into the zero pool, zeroing them outside
+ * frame_lock. */
+static void
+kswapd_fill_zero_pool (void) {
+	for (;;) {
+		void *kva = palloc_get_page(PAL_USER | PAL_ZERO);
+		if (kva == NULL)
+			return;
+
+		lock_acquire(&frame_lock);
+		bool parked = zero_cnt < kswapd_zero;
+		if (parked) {
+			zero_pool[zero_cnt++] = kva;
+			frames_used++;
+		}
+		lock_release(&frame_lock);
+
+		if (!parked) {
+			palloc_free_page(kva);
+			return;
+		}
+	}
+}
+
+/* The reclaim daemon.  Sleeps until vm_get_frame() sees free frames drop
+ * below kswapd_low, then runs the eviction clock ahead of demand until
+ * kswapd_high are free, writing dirty victims back, and tops up the zero
+ * pool.  frame_lock is not held while a victim is written back, so a
+ * faulting thread waits for the write only if it needs the victim's
+ * pages. */
+static void
+kswapd (void *aux UNUSED) {
+	for (;;) {
+		sema_down(&kswapd_wakeup);
+		while (kswapd_reclaim_one())
+			continue;
+		kswapd_fill_zero_pool();
+
+		lock_acquire(&frame_lock);
+		kswapd_awake = false;
+		lock_release(&frame_lock);
+	}
+}
+
 /* Growing the stack. */
 static void
 vm_stack_growth (void *addr UNUSED) {
@@ -266,9 +468,44 @@ vm_stack_growth (void *addr UNUSED) {
   vm_alloc_page(VM_ANON | VM_MARKER_0, addr, true);
 }
 
-/* Handle the fault on write_protected page */
+/* Handle the fault on write_protected page.
+ * PAGE is writable but mapped read-only because its frame is shared
+ * copy-on-write.  The last sharer simply takes the frame over; otherwise
+ * the page gets a private copy and drops its reference to the old frame. */
 static bool
-vm_handle_wp (struct page *page UNUSED) {
+vm_handle_wp (struct page *page) {
+	struct frame *old_frame;
+	struct frame *new_frame;
+	bool success;
+
+	lock_acquire(&frame_lock);
+	old_frame = page_frame(page);
+	if (old_frame == NULL) {
+		/* Evicted since the fault; the retried access swaps it back in. */
+		lock_release(&frame_lock);
+		return true;
+	}
+	if (old_frame->ref_cnt == 1) {
+		success = pml4_set_page(page->pml4, page->va, old_frame->kva, true);
+		lock_release(&frame_lock);
+		return success;
+	}
+
+	/* Keep the shared frame from being evicted while we copy it. */
+	old_frame->pin_cnt++;
+	lock_release(&frame_lock);
+
+	new_frame = vm_get_frame ();
+	page_copy(new_frame->kva, old_frame->kva);
+
+	lock_acquire(&frame_lock);
+	frame_unmap_page(page);
+	frame_add_page(new_frame, page);
+	success = pml4_set_page(page->pml4, page->va, new_frame->kva, true);
+	lock_release(&frame_lock);
+	frame_unpin(old_frame);
+	frame_unpin(new_frame);
+	return success;
 }
 
 /* Return true on success */
@@ -282,6 +519,7 @@ vm_try_handle_fault (struct intr_frame *f UNUSED, void *addr UNUSED, bool user U
 		// printf("handle fault is kernel addr!!!!!\n");
 		return false;
 	}
+	spt->fault_cnt++;
 	if (page == NULL) {
 		// printf("handle fault page is nulllllllll!%p\n", addr);
 		if(USER_STACK - (uint64_t)addr <= ONE_MB){
@@ -300,13 +538,215 @@ vm_try_handle_fault (struct intr_frame *f UNUSED, void *addr UNUSED, bool user U
 		}
 		return false;
 	}
+	/* 존재하는 페이지에 대한 쓰기 fault는 copy-on-write 공유 해제 */
+	if (!not_present)
+		return write && page->writable && vm_handle_wp (page);
 	if(write && !page->writable) {
 		// printf("vm hanele fault page write!!\n");
 		return false;
 	}
+
+	/* 미리 읽어 둔 페이지는 매핑만 하면 됨 */
+	if (page->frame != NULL) {
+		if (!vm_map_loaded_page (page))
+			return false;
+		if (page->f != NULL && page->va + PGSIZE == spt->ra_end)
+			vm_read_ahead (spt, page, page->f, page->offset, true);
+		return true;
+	}
+
+	struct file *file;
+	off_t ofs;
+	size_t read_bytes;
+	bool from_file = page_file_source (page, &file, &ofs, &read_bytes);
+
 	page->va = pg_round_down(addr);
 	// printf("vm hanele fault page done!!\n");
-	return vm_do_claim_page (page);
+	if (!vm_do_claim_page (page))
+		return false;
+	spt->major_fault_cnt++;
+	if (from_file)
+		vm_read_ahead (spt, page, file, ofs, page->va == spt->ra_end);
+	return true;
+}
+
+/* If PAGE is not in memory and its contents come from a file, stores
+ * that file, the offset of the page's data and its length in *FILE, *OFS
+ * and *READ_BYTES and returns true.  Lazily loaded segment and mmap pages carry a struct
+ * file_info as their aux; evicted file-backed pages remember their file
+ * themselves.  Pages with no file data to read are not reported. */
+static bool
+page_file_source (struct page *page, struct file **file, off_t *ofs,
+		size_t *read_bytes) {
+	if (page->frame != NULL)
+		return false;
+	switch (VM_TYPE(page->operations->type)) {
+		case VM_UNINIT: {
+			struct file_info *info = page->uninit.aux;
+			if (info == NULL || info->read_bytes == 0)
+				return false;
+			*file = info->file;
+			*ofs = info->offset;
+			*read_bytes = info->read_bytes;
+			return true;
+		}
+		case VM_FILE:
+			if (page->read_bytes == 0)
+				return false;
+			*file = page->f;
+			*ofs = page->offset;
+			*read_bytes = page->read_bytes;
+			return true;
+		default:
+			return false;
+	}
+}
+
+/* Reads pages that follow PAGE in FILE (where PAGE's data is at OFS)
+ * into frames without mapping them, so that touching them later costs
+ * only a minor fault instead of a file read.  Mapping them right away
+ * would make never-touched pages look loaded, which lazy loading
+ * forbids.
+ * The window doubles, up to RA_MAX_PAGES, while faults stay SEQUENTIAL,
+ * i.e. land on the page right after the previous window, and collapses
+ * to nothing on any other fault.  The window covers only the run of
+ * pages whose data follows on back to back in FILE, and never eats into
+ * the frames the reclaim daemon keeps free.  The whole run is read with
+ * one inode_readv() scattered over its frames rather than a read per
+ * page; if that fails, the frames are dropped again and each page is
+ * left to load on its own fault. */
+static void
+vm_read_ahead (struct supplemental_page_table *spt, struct page *page,
+		struct file *file, off_t ofs, bool sequential) {
+	struct page *pages[RA_MAX_PAGES];
+	struct iovec iov[RA_MAX_PAGES];
+	void *va = page->va + PGSIZE;
+	size_t cnt = 0, total = 0;
+	bool loaded;
+	size_t i;
+
+	if (!sequential)
+		spt->ra_window = 0;
+	else if (spt->ra_window == 0)
+		spt->ra_window = RA_MIN_PAGES;
+	else if (spt->ra_window < RA_MAX_PAGES)
+		spt->ra_window *= 2;
+
+	while (cnt < spt->ra_window) {
+		struct page *next = spt_find_page(spt, va);
+		struct file *next_file;
+		off_t next_ofs;
+		size_t read_bytes;
+		bool spare;
+
+		if (next == NULL
+				|| !page_file_source(next, &next_file, &next_ofs,
+					&read_bytes)
+				|| next_file != file
+				|| next_ofs != ofs + (off_t) ((cnt + 1) * PGSIZE))
+			break;
+
+		lock_acquire(&frame_lock);
+		spare = frames_available() > kswapd_high;
+		lock_release(&frame_lock);
+		if (!spare)
+			break;
+
+		struct frame *frame = vm_get_frame ();
+		lock_acquire(&frame_lock);
+		next->pml4 = thread_current()->pml4;
+		frame_add_page(frame, next);
+		lock_release(&frame_lock);
+
+		pages[cnt] = next;
+		iov[cnt].iov_base = frame->kva;
+		iov[cnt].iov_len = read_bytes;
+		total += read_bytes;
+		cnt++;
+		va += PGSIZE;
+
+		/* The rest of this page is zeros, not the next page's data. */
+		if (read_bytes < PGSIZE)
+			break;
+	}
+	spt->ra_end = va;
+	if (cnt == 0)
+		return;
+
+	loaded = inode_readv (file_get_inode (file), iov, cnt,
+			ofs + PGSIZE) == (off_t) total;
+	for (i = 0; i < cnt; i++) {
+		struct frame *frame = pages[i]->frame;
+		size_t read_bytes = iov[i].iov_len;
+
+		if (loaded)
+			loaded = page_adopt_file_data (pages[i], frame->kva,
+					read_bytes);
+		if (!loaded)
+			delete_frame (pages[i]);
+		frame_unpin (frame);
+	}
+}
+
+/* Finishes loading PAGE, whose first READ_BYTES bytes of file data have
+ * already been read into its frame at KVA, as its swap_in would have:
+ * zeros the rest of the frame and, for a page that has never been
+ * loaded, turns it into its final type and takes over the file_info it
+ * was created with. */
+static bool
+page_adopt_file_data (struct page *page, void *kva, size_t read_bytes) {
+	memset (kva + read_bytes, 0, PGSIZE - read_bytes);
+	if (VM_TYPE(page->operations->type) == VM_UNINIT) {
+		/* Fetch first, the initializer may overwrite the union. */
+		struct file_info *info = page->uninit.aux;
+		enum vm_type type = page->uninit.type;
+
+		if (!page->uninit.page_initializer (page, type, kva))
+			return false;
+		page->f = info->file;
+		page->offset = info->offset;
+		page->read_bytes = info->read_bytes;
+		page->zero_bytes = info->zero_bytes;
+		page->writable = info->writable;
+		free (info);
+	}
+	return true;
+}
+
+/* Maps PAGE, which is already loaded in a frame, into its page table. */
+static bool
+vm_map_loaded_page (struct page *page) {
+	struct frame *frame;
+	bool success;
+
+	lock_acquire(&frame_lock);
+	frame = page_frame(page);
+	if (frame == NULL) {
+		/* Evicted before it was ever touched. */
+		lock_release(&frame_lock);
+		return vm_do_claim_page (page);
+	}
+	success = pml4_set_page(page->pml4, page->va, frame->kva,
+			page->writable && frame->ref_cnt == 1);
+	lock_release(&frame_lock);
+	return success;
+}
+
+/* Page fault counters of the current process, for tests.  Calling this
+ * function via int 0x45.
+ * Input:
+ *   @RDX - 0 for all handled faults, 1 for faults that loaded a page
+ * Output:
+ *   @RAX - Fault count. */
+static void
+inspect_fault_cnt (struct intr_frame *f) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	f->R.rax = f->R.rdx == 0 ? spt->fault_cnt : spt->major_fault_cnt;
+}
+
+static void
+register_fault_inspect_intr (void) {
+	intr_register_int (0x45, 3, INTR_OFF, inspect_fault_cnt, "Inspect Page Fault Count");
 }
 
 /* Free the page.
@@ -334,22 +774,97 @@ static bool
 vm_do_claim_page (struct page *page) {
 	struct thread *cur = thread_current();
 	struct frame *frame = vm_get_frame ();
+	bool success;
 	// struct supplemental_page_table *spt = &cur->spt;
 
 	/* Set links */
-	frame->page = page;
-	page->frame = frame;
+	lock_acquire(&frame_lock);
+	page->pml4 = cur->pml4;
+	frame_add_page(frame, page);
 	// printf("vm do claim page %p writable %s kva %p!!\n", page->va, page->writable ? "true" : "false", frame->kva);
 	pml4_set_page(cur->pml4, page->va, frame->kva, page->writable);
+	lock_release(&frame_lock);
 	/* TODO: Insert page table entry to map page's VA to frame's PA. */
 	// printf("vm do claim page insert!!!!!!!%d va %p\n", page_get_type(page), page->va);
-	return swap_in (page, frame->kva);
+	success = swap_in (page, frame->kva);
+
+	/* The frame stays pinned until its contents are in place. */
+	frame_unpin(frame);
+	return success;
+}
+
+/* Makes PAGE resident and pins its frame.  If WRITE, the page is
+ * also given a private frame mapped writable, so that the kernel can
+ * store into it through its user address without faulting.
+ * Returns false if PAGE cannot be brought in. */
+static bool
+vm_pin_page (struct page *page, bool write) {
+	for (;;) {
+		struct frame *frame;
+		uint64_t *pte;
+
+		lock_acquire(&frame_lock);
+		frame = page_frame(page);
+		pte = pml4e_walk(page->pml4, (uint64_t) page->va, 0);
+		if (frame != NULL && (!write || (pte != NULL && is_writable(pte)))) {
+			frame->pin_cnt++;
+			lock_release(&frame_lock);
+			return true;
+		}
+		lock_release(&frame_lock);
+
+		if (frame == NULL ? !vm_do_claim_page(page) : !vm_handle_wp(page))
+			return false;
+	}
+}
+
+/* Unpins the frames of the pages from START up to END. */
+static void
+vm_unpin_pages (void *start, void *end) {
+	struct supplemental_page_table *spt = &thread_current()->spt;
+	void *va;
+
+	for (va = start; va < end; va += PGSIZE)
+		frame_unpin(spt_find_page(spt, va)->frame);
+}
+
+/* Pins the frames behind the SIZE bytes of user memory at BUFFER,
+ * bringing them in first, so that they can be accessed without
+ * faulting until vm_unpin_buffer(), e.g. by a disk transfer.
+ * If WRITE, the kernel is going to store into BUFFER, which must be
+ * writable.  Returns false, with nothing pinned, if some page of
+ * BUFFER is not mapped or cannot be brought in. */
+bool
+vm_pin_buffer (void *buffer, size_t size, bool write) {
+	struct supplemental_page_table *spt = &thread_current()->spt;
+	void *start = pg_round_down(buffer);
+	void *va;
+
+	for (va = start; va < buffer + size; va += PGSIZE) {
+		struct page *page = spt_find_page(spt, va);
+		if (page == NULL || (write && !page->writable)
+				|| !vm_pin_page(page, write)) {
+			vm_unpin_pages(start, va);
+			return false;
+		}
+	}
+	return true;
+}
+
+/* Unpins the buffer pinned by vm_pin_buffer(). */
+void
+vm_unpin_buffer (void *buffer, size_t size) {
+	vm_unpin_pages(pg_round_down(buffer), buffer + size);
 }
 
 /* Initialize new supplemental page table */
 void
 supplemental_page_table_init (struct supplemental_page_table *spt UNUSED) {
 	hash_init(&spt->hash_page_table, page_hash, page_less, NULL);
+	spt->ra_end = NULL;
+	spt->ra_window = 0;
+	spt->fault_cnt = 0;
+	spt->major_fault_cnt = 0;
 }
 
 static void copy_elem(struct hash_elem *hash_elem, void* aux) {
@@ -377,28 +892,63 @@ static void delete_elem(struct hash_elem *hash_elem, void* aux) {
 	}
 }
 
+/* Returns the frame table entry for user pool page KVA. */
+struct frame *frame_lookup(const void *kva) {
+	size_t idx = pg_no(kva) - pg_no(frame_base);
+
+	ASSERT (pg_ofs(kva) == 0);
+	ASSERT (idx < frame_cnt);
+	return &frame_table[idx];
+}
+
+/* Unmaps every page sharing the frame at KVA and frees it. */
 void free_frame(void *kva) {
-	struct list_elem *cur_elem = list_begin(&frame_table);
+	struct frame *frame = frame_lookup(kva);
 
-		while (cur_elem != list_end(&frame_table)) {
-			struct frame *found_frame = list_entry(cur_elem, struct frame, frame_elem);
-			if (found_frame->kva == kva) {
-				delete_frame(found_frame->page);
-				break;
-			}
-			cur_elem = list_next(cur_elem);
-		}
+	lock_acquire(&frame_lock);
+	while (frame->evicting)
+		cond_wait(&evict_done, &frame_lock);
+	while (frame->kva != NULL && !list_empty(&frame->pages))
+		frame_unmap_page(list_entry(list_front(&frame->pages), struct page, frame_elem));
+	lock_release(&frame_lock);
 }
 
+/* Unmaps P from its frame, freeing the frame once no page shares it. */
 void delete_frame(struct page *p) {
-	if(p->frame != NULL) {
-		del_frame_from_frame_table(p->frame);
-		pml4_clear_page(thread_current()->pml4, p->va);
-	 	palloc_free_page(p->frame->kva);
-		free(p->frame);
+	lock_acquire(&frame_lock);
+	frame_unmap_page(p);
+	lock_release(&frame_lock);
+}
+
+/* Does the work of delete_frame().  Caller must hold frame_lock. */
+static void frame_unmap_page (struct page *p) {
+	struct frame *frame = page_frame(p);
+
+	if(frame != NULL) {
+		pml4_clear_page(p->pml4, p->va);
+		list_remove(&p->frame_elem);
+		p->frame = NULL;
+		if (--frame->ref_cnt == 0 && frame->pin_cnt == 0)
+			frame_free(frame);
 	}
 }
 
+/* Drops a pin on FRAME, freeing it if its last page went away while it
+ * was pinned (e.g. a lazy load that failed and deleted its page). */
+static void frame_unpin (struct frame *frame) {
+	lock_acquire(&frame_lock);
+	if (--frame->pin_cnt == 0 && frame->ref_cnt == 0)
+		frame_free(frame);
+	lock_release(&frame_lock);
+}
+
+/* Returns FRAME's page to the user pool.  Caller must hold frame_lock. */
+static void frame_free (struct frame *frame) {
+	palloc_free_page(frame->kva);
+	frame->kva = NULL;
+	frames_used--;
+}
+
 /* Free the resource hold by the supplemental page table */
 void
 supplemental_page_table_kill (struct supplemental_page_table *spt UNUSED) {
@@ -437,26 +987,57 @@ page_lookup (const void *address) {
 }
 
 
-void add_frame_to_frame_table(struct frame *frame) {
-	// printf("add frame to frame table\n");
-	list_push_back(&frame_table, &frame->frame_elem);
-	// printf("add frame to frame table done\n");
+/* Records that PAGE is mapped onto FRAME.  Caller must hold frame_lock. */
+static void frame_add_page (struct frame *frame, struct page *page) {
+	list_push_back(&frame->pages, &page->frame_elem);
+	frame->ref_cnt++;
+	page->frame = frame;
 }
 
-void del_frame_from_frame_table(struct frame *frame) {
-	list_remove(&frame->frame_elem);
+/* Maps CHILD onto PARENT's frame copy-on-write.  Both pages keep the
+ * frame read-only until one of them writes to it; see vm_handle_wp().
+ * Caller must hold frame_lock. */
+static bool vm_share_frame (struct page *child, struct page *parent) {
+	struct frame *frame = parent->frame;
+
+	if (!pml4_set_page(child->pml4, child->va, frame->kva, false))
+		return false;
+	if (parent->writable) {
+		/* pml4_set_page() resets the PTE, so carry the dirty bit over. */
+		bool dirty = pml4_is_dirty(parent->pml4, parent->va);
+		pml4_set_page(parent->pml4, parent->va, frame->kva, false);
+		pml4_set_dirty(parent->pml4, parent->va, dirty);
+	}
+	frame_add_page(frame, child);
+	return true;
 }
 
-static struct list_elem *get_next_lru_clock() {
-	if (list_empty(&frame_table)) {
-		return NULL;
+/* Returns true if any page mapped onto FRAME was accessed since the last
+ * call, clearing the accessed bit in each sharer's page table. */
+static bool frame_test_and_clear_accessed (struct frame *frame) {
+	bool accessed = false;
+	struct list_elem *e;
+
+	for (e = list_begin(&frame->pages); e != list_end(&frame->pages); e = list_next(e)) {
+		struct page *p = list_entry(e, struct page, frame_elem);
+		if (pml4_is_accessed(p->pml4, p->va)) {
+			accessed = true;
+			pml4_set_accessed(p->pml4, p->va, false);
+		}
 	}
-	struct list_elem *next_clock = list_next(lru_clock);
-	if (next_clock == list_tail(&frame_table)) {
-		next_clock = list_begin(&frame_table);
+	return accessed;
+}
+
+/* Returns true if any page mapped onto FRAME has written to it. */
+static bool frame_is_dirty (struct frame *frame) {
+	struct list_elem *e;
+
+	for (e = list_begin(&frame->pages); e != list_end(&frame->pages); e = list_next(e)) {
+		struct page *p = list_entry(e, struct page, frame_elem);
+		if (pml4_is_dirty(p->pml4, p->va))
+			return true;
 	}
-	lru_clock = next_clock;
-	return next_clock;
+	return false;
 }
 
 void delete_page (struct page *page) {